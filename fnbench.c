@@ -0,0 +1,715 @@
+/* fnbench -- benchmark fnmatch.c and check it against its old self.
+
+   Usage: fnbench [-b] [-f] [-M dirlist] [-n count] [-s seed]
+
+   -b	only benchmark: time `fnmatch' and `fnmatch_batch' on the names
+	found in the man page trees of DIRLIST (MANPATH by default),
+	with the patterns `man' makes for them, and on a few
+	pathological star patterns, next to the C library's `fnmatch'
+	and, on the topics only, the old matcher in fnbase.c.
+   -f	only fuzz: match COUNT random patterns and names (100000 by
+	default, seeded with SEED) under every combination of the flags
+	in fnmatch.h, and compare the results of fnmatch.c with those of
+	the old matcher, of `fnmatch_batch' and of the C library's
+	`fnmatch'.  Every divergence is cut down to a minimal pattern,
+	name and flag set and printed as a reproducer.
+
+   The exit status is 1 if fnmatch.c diverges from the old matcher or
+   from `fnmatch_batch'.  The C library's divergences are printed but
+   do not count: the old GNU code has its own ways with brackets like
+   "[" and "[]" and with FNM_LEADING_DIR, and fnmatch.c keeps them.
+
+   fnmatch.c is compiled into this program under other names, so the
+   C library's `fnmatch' stays available.  Comparing with it needs a
+   library whose <fnmatch.h> uses the GNU flag values, like glibc;
+   define HOST_FNMATCH to vouch for another one.  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+
+/* The code under test.  */
+#define FNMATCH_ALWAYS	1
+#define fnmatch		own_fnmatch
+#define fnmatch_batch	own_fnmatch_batch
+#define fnmatch_fold_key own_fnmatch_fold_key
+#ifndef HAVE_STRING_H
+# define HAVE_STRING_H	1
+#endif
+#ifndef STDC_HEADERS
+# define STDC_HEADERS	1
+#endif
+#include "fnmatch.c"
+#undef fnmatch
+#undef fnmatch_batch
+#undef fnmatch_fold_key
+
+#if defined __GLIBC__ && !defined HOST_FNMATCH
+# define HOST_FNMATCH	1
+#endif
+
+/* The reference: fnmatch.c before its matcher was reworked.  */
+extern int base_fnmatch __P ((const char *pattern, const char *name,
+			      int flags));
+
+#ifdef HOST_FNMATCH
+/* The C library's.  Its flags have the same values as ours.  */
+extern int fnmatch __P ((const char *pattern, const char *name, int flags));
+#endif
+
+#if defined (MSDOS) || defined (__WIN32__)
+# define PATH_SEP	';'
+#else
+# define PATH_SEP	':'
+#endif
+
+static const char *progname;
+
+static void *xmalloc __P ((size_t size));
+static void *
+xmalloc (size)
+     size_t size;
+{
+  void *p = malloc (size);
+
+  if (!p)
+    {
+      fprintf (stderr, "%s: virtual memory exhausted\n", progname);
+      exit (4);
+    }
+  return p;
+}
+
+static void *xrealloc __P ((void *p, size_t size));
+static void *
+xrealloc (p, size)
+     void *p;
+     size_t size;
+{
+  p = realloc (p, size);
+  if (!p)
+    {
+      fprintf (stderr, "%s: virtual memory exhausted\n", progname);
+      exit (4);
+    }
+  return p;
+}
+
+static char *xstrdup __P ((const char *s));
+static char *
+xstrdup (s)
+     const char *s;
+{
+  return strcpy ((char *)xmalloc (strlen (s) + 1), s);
+}
+
+/* A growing array of strings.  */
+typedef struct {
+  char **v;
+  int n, max;
+} Strings;
+
+static void add_string __P ((Strings *s, const char *str));
+static void
+add_string (s, str)
+     Strings *s;
+     const char *str;
+{
+  if (s->n >= s->max)
+    {
+      s->max = s->max ? 2 * s->max : 256;
+      s->v = (char **)xrealloc (s->v, s->max * sizeof (char *));
+    }
+  s->v[s->n++] = xstrdup (str);
+}
+
+static void free_strings __P ((Strings *s));
+static void
+free_strings (s)
+     Strings *s;
+{
+  while (s->n > 0)
+    free (s->v[--s->n]);
+  free (s->v);
+  s->v = NULL;
+  s->max = 0;
+}
+
+/* Benchmarking.  */
+
+/* At most this many names are taken from the man page trees.  */
+#define MAX_NAMES	200000
+
+/* Each measurement runs for at least this long.  */
+#define MIN_SECONDS	0.25
+
+/* Add the names in directory DIR to NAMES, and if DEPTH is non-zero,
+   those in its subdirectories as well, the way `man' reads them.  */
+static void add_dir_names __P ((Strings *names, const char *dir, int depth));
+static void
+add_dir_names (names, dir, depth)
+     Strings *names;
+     const char *dir;
+     int depth;
+{
+  DIR *dp = opendir (dir);
+  struct dirent *de;
+
+  if (!dp)
+    return;
+  while ((de = readdir (dp)) != 0 && names->n < MAX_NAMES)
+    {
+      if (strcmp (de->d_name, ".") == 0 || strcmp (de->d_name, "..") == 0)
+	continue;
+      add_string (names, de->d_name);
+      if (depth && (strncmp (de->d_name, "man", 3) == 0
+		    || strncmp (de->d_name, "cat", 3) == 0))
+	{
+	  char *sub = (char *)xmalloc (strlen (dir) + strlen (de->d_name) + 2);
+
+	  sprintf (sub, "%s/%s", dir, de->d_name);
+	  add_dir_names (names, sub, depth - 1);
+	  free (sub);
+	}
+    }
+  closedir (dp);
+}
+
+/* The names in all the directories of DIRLIST.  If there are none,
+   make up names like those of a man page tree.  */
+static void collect_names __P ((Strings *names, const char *dirlist));
+static void
+collect_names (names, dirlist)
+     Strings *names;
+     const char *dirlist;
+{
+  char *list = xstrdup (dirlist), *dir, *end;
+  int i;
+
+  for (dir = list; dir; dir = end)
+    {
+      end = strchr (dir, PATH_SEP);
+      if (end)
+	*end++ = '\0';
+      if (*dir)
+	add_dir_names (names, dir, 1);
+    }
+  free (list);
+
+  if (names->n == 0)
+    {
+      char name[32];
+
+      fprintf (stderr, "%s: no pages in `%s', using made-up names\n",
+	       progname, dirlist);
+      for (i = 0; i < 5000; i++)
+	{
+	  sprintf (name, "%s%d.%c%s", i % 3 ? "page" : "Func_", i,
+		   "123456789ln"[i % 11], i % 7 ? "" : ".gz");
+	  add_string (names, name);
+	}
+      for (i = 1; i <= 9; i++)
+	{
+	  sprintf (name, "man%d", i);
+	  add_string (names, name);
+	  sprintf (name, "cat%d", i);
+	  add_string (names, name);
+	}
+    }
+}
+
+/* The suffixes `find_pages' puts after a topic.  */
+static const char *const suffixes[] = {
+  ".[!iz]*", ".3*", ".1", ".[1-9]?"
+};
+#define NSUFFIXES (int)(sizeof suffixes / sizeof suffixes[0])
+
+/* The patterns `man' would look for the topics of some of NAMES with,
+   as `find_pages' makes them: with SUFFIX, or with each of `suffixes'
+   in turn if SUFFIX is null.  */
+static void topic_patterns __P ((Strings *patterns, const Strings *names,
+				 int ntopics, const char *suffix));
+static void
+topic_patterns (patterns, names, ntopics, suffix)
+     Strings *patterns;
+     const Strings *names;
+     int ntopics;
+     const char *suffix;
+{
+  char pattern[FILENAME_MAX + 16];
+  int step = names->n / ntopics + 1, i;
+
+  for (i = 0; i < names->n; i += step)
+    {
+      const char *dot = strchr (names->v[i], '.');
+      size_t len = dot ? (size_t)(dot - names->v[i]) : strlen (names->v[i]);
+
+      if (len == 0 || len > FILENAME_MAX)
+	continue;
+      memcpy (pattern, names->v[i], len);
+      strcpy (pattern + len,
+	      suffix ? suffix : suffixes[(i / step) % NSUFFIXES]);
+      add_string (patterns, pattern);
+    }
+}
+
+/* Time matching every one of PATTERNS against every one of NAMES with
+   MATCHER, and print the rate under the heading WHAT.  */
+static void time_matcher __P ((const char *what, const Strings *patterns,
+			       const Strings *names, int flags,
+			       int (*matcher) (const char *, const char *, int)));
+static void
+time_matcher (what, patterns, names, flags, matcher)
+     const char *what;
+     const Strings *patterns;
+     const Strings *names;
+     int flags;
+     int (*matcher) __P ((const char *, const char *, int));
+{
+  clock_t start = clock ();
+  double seconds;
+  unsigned long calls = 0, matches = 0;
+  int i, j;
+
+  do
+    {
+      for (i = 0; i < patterns->n; i++)
+	for (j = 0; j < names->n; j++)
+	  if ((*matcher) (patterns->v[i], names->v[j], flags) == 0)
+	    matches++;
+      calls += (unsigned long)patterns->n * names->n;
+      seconds = (double)(clock () - start) / CLOCKS_PER_SEC;
+    }
+  while (seconds < MIN_SECONDS && calls > 0);
+
+  printf ("%-34s %10lu calls %9.1f ns/call %8lu matches\n", what, calls,
+	  calls ? seconds * 1e9 / calls : 0.0, matches);
+}
+
+/* Time looking for each of PATTERNS in NAMES the way `try_directory'
+   does: with the subdirectory patterns, 64 names at a time.  */
+static void time_batch __P ((const char *what, const Strings *patterns,
+			     const Strings *names));
+static void
+time_batch (what, patterns, names)
+     const char *what;
+     const Strings *patterns;
+     const Strings *names;
+{
+  const char *batch[3];
+  int batch_flags[3];
+  unsigned matches[64];
+  clock_t start = clock ();
+  double seconds;
+  unsigned long calls = 0, matched = 0;
+  int i, j;
+
+  batch[1] = "man?";
+  batch[2] = "cat?";
+  batch_flags[0] = batch_flags[1] = batch_flags[2] = 0;
+  do
+    {
+      for (i = 0; i < patterns->n; i++)
+	{
+	  batch[0] = patterns->v[i];
+	  for (j = 0; j < names->n; j += 64)
+	    matched += own_fnmatch_batch (batch, batch_flags, 3,
+					  (const char *const *)names->v + j,
+					  names->n - j < 64 ? names->n - j : 64,
+					  matches);
+	}
+      calls += 3UL * patterns->n * names->n;
+      seconds = (double)(clock () - start) / CLOCKS_PER_SEC;
+    }
+  while (seconds < MIN_SECONDS && calls > 0);
+
+  printf ("%-34s %10lu calls %9.1f ns/call %8lu matches\n", what, calls,
+	  calls ? seconds * 1e9 / calls : 0.0, matched);
+}
+
+/* Run all the benchmarks on the man page trees in DIRLIST.  */
+static void benchmark __P ((const char *dirlist));
+static void
+benchmark (dirlist)
+     const char *dirlist;
+{
+  static const char *const star_patterns[] = {
+    "*a*a*a*a*a*a*a*a*b", "*?*?*?*?*?*?*?*?x", "*[ab]*[ab]*[ab]*c",
+    "***************z", "a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*a*"
+  };
+  Strings names, patterns, stars, long_names, kind;
+  char name[72];
+  int i;
+
+  memset (&names, 0, sizeof names);
+  memset (&patterns, 0, sizeof patterns);
+  memset (&stars, 0, sizeof stars);
+  memset (&long_names, 0, sizeof long_names);
+
+  collect_names (&names, dirlist);
+  topic_patterns (&patterns, &names, 16, NULL);
+  printf ("%d names, %d topic patterns\n", names.n, patterns.n);
+
+  for (i = 0; i < (int)(sizeof star_patterns / sizeof star_patterns[0]); i++)
+    add_string (&stars, star_patterns[i]);
+  for (i = 0; i < 16; i++)
+    {
+      memset (name, 'a', sizeof name - 1);
+      name[sizeof name - 1 - i] = '\0';
+      add_string (&long_names, name);
+    }
+
+  time_matcher ("fnmatch, topics", &patterns, &names, 0, own_fnmatch);
+  time_matcher ("fnmatch, topics, FNM_CASEFOLD", &patterns, &names,
+		FNM_CASEFOLD, own_fnmatch);
+  time_batch ("fnmatch_batch, topics + man?/cat?", &patterns, &names);
+  time_matcher ("fnmatch, star patterns", &stars, &long_names, 0,
+		own_fnmatch);
+#ifdef HOST_FNMATCH
+  time_matcher ("C library, topics", &patterns, &names, 0, fnmatch);
+  time_matcher ("C library, star patterns", &stars, &long_names, 0, fnmatch);
+#endif
+
+  /* Each kind of pattern against the old matcher; not the star
+     patterns, on which it takes exponential time.  */
+  for (i = 0; i <= NSUFFIXES; i++)
+    {
+      memset (&kind, 0, sizeof kind);
+      if (i < NSUFFIXES)
+	{
+	  topic_patterns (&kind, &names, 16, suffixes[i]);
+	  sprintf (name, "topic%s", suffixes[i]);
+	}
+      else
+	{
+	  add_string (&kind, "man?");
+	  strcpy (name, "man?");
+	}
+      printf ("\n");
+      time_matcher (name, &kind, &names, 0, own_fnmatch);
+      sprintf (name + strlen (name), ", old fnmatch");
+      time_matcher (name, &kind, &names, 0, base_fnmatch);
+      free_strings (&kind);
+    }
+}
+
+/* Differential fuzzing.  */
+
+#define ALL_FLAGS (FNM_PATHNAME | FNM_NOESCAPE | FNM_PERIOD \
+		   | FNM_LEADING_DIR | FNM_CASEFOLD)
+
+/* Which matcher disagrees with `own_fnmatch'.  */
+#define AGAINST_BASE	0
+#define AGAINST_BATCH	1
+#define AGAINST_LIBC	2
+#define NMATCHERS	3
+
+static const char *const matcher_names[NMATCHERS] = {
+  "the old fnmatch", "fnmatch_batch", "the C library"
+};
+
+/* At most this many reproducers are printed for each matcher.  */
+#define MAX_REPORTS	25
+
+static unsigned long seed = 1;
+
+/* A pseudo-random number below N; the same sequence on every host.  */
+static unsigned random_below __P ((unsigned n));
+static unsigned
+random_below (n)
+     unsigned n;
+{
+  seed = seed * 1103515245UL + 12345UL;
+  return (unsigned)((seed >> 16) & 0x7fff) % n;
+}
+
+/* Make up a pattern out of pieces which exercise the matcher.  */
+static void random_pattern __P ((char *pattern));
+static void
+random_pattern (pattern)
+     char *pattern;
+{
+  static const char *const pieces[] = {
+    "a", "b", "A", "B", ".", "/", "-", "*", "*", "?", "\\", "\\*", "\\a",
+    "[", "]", "[ab]", "[!a]", "[^b]", "[a-z]", "[]a]", "[!]]", "[a-]",
+    "[\\]]", "[.]", "[/]", "[[:alpha:]]", "[[:upper:]]", "[[:digit:]]",
+    "[[:foo:]]", "[[:"
+  };
+  int n = random_below (7), i;
+
+  pattern[0] = '\0';
+  for (i = 0; i < n; i++)
+    strcat (pattern,
+	    pieces[random_below (sizeof pieces / sizeof pieces[0])]);
+}
+
+/* Make up a name for the patterns to match.  */
+static void random_name __P ((char *name));
+static void
+random_name (name)
+     char *name;
+{
+  static const char chars[] = "aAbB./-*?[]\\1z";
+  int n = random_below (9), i;
+
+  for (i = 0; i < n; i++)
+    name[i] = chars[random_below (sizeof chars - 1)];
+  name[n] = '\0';
+}
+
+/* 0 for a match, 1 for no match, 2 for an error.  */
+static int outcome __P ((int result));
+static int
+outcome (result)
+     int result;
+{
+  return result == 0 ? 0 : result == FNM_NOMATCH ? 1 : 2;
+}
+
+/* What the matcher AGAINST says about NAME and PATTERN under FLAGS.  */
+static int other_outcome __P ((int against, const char *pattern,
+			       const char *name, int flags));
+static int
+other_outcome (against, pattern, name, flags)
+     int against;
+     const char *pattern;
+     const char *name;
+     int flags;
+{
+  unsigned match;
+
+  if (against == AGAINST_BASE)
+    return outcome (base_fnmatch (pattern, name, flags));
+  if (against == AGAINST_BATCH)
+    {
+      own_fnmatch_batch (&pattern, &flags, 1, &name, 1, &match);
+      return !match;
+    }
+#ifdef HOST_FNMATCH
+  return outcome (fnmatch (pattern, name, flags));
+#else
+  return 1;
+#endif
+}
+
+/* Non-zero if `own_fnmatch' and the matcher AGAINST disagree.  The
+   batch matcher cannot tell errors from mismatches.  */
+static int diverges __P ((int against, const char *pattern, const char *name,
+			  int flags));
+static int
+diverges (against, pattern, name, flags)
+     int against;
+     const char *pattern;
+     const char *name;
+     int flags;
+{
+  int own = outcome (own_fnmatch (pattern, name, flags));
+
+  if (against == AGAINST_BATCH && own == 2)
+    own = 1;
+  return own != other_outcome (against, pattern, name, flags);
+}
+
+/* Cut down PATTERN, NAME and *FLAGS as long as the divergence stays.  */
+static void minimize __P ((int against, char *pattern, char *name,
+			   int *flags));
+static void
+minimize (against, pattern, name, flags)
+     int against;
+     char *pattern;
+     char *name;
+     int *flags;
+{
+  char saved[128];
+  int changed = 1, bit;
+  size_t i;
+
+  while (changed)
+    {
+      changed = 0;
+      for (i = 0; pattern[i]; i++)
+	{
+	  strcpy (saved, pattern);
+	  memmove (pattern + i, pattern + i + 1, strlen (pattern + i));
+	  if (diverges (against, pattern, name, *flags))
+	    changed = 1, i--;
+	  else
+	    strcpy (pattern, saved);
+	}
+      for (i = 0; name[i]; i++)
+	{
+	  strcpy (saved, name);
+	  memmove (name + i, name + i + 1, strlen (name + i));
+	  if (diverges (against, pattern, name, *flags))
+	    changed = 1, i--;
+	  else
+	    strcpy (name, saved);
+	}
+      for (bit = 1; bit <= ALL_FLAGS; bit <<= 1)
+	if ((*flags & bit) && diverges (against, pattern, name, *flags & ~bit))
+	  {
+	    *flags &= ~bit;
+	    changed = 1;
+	  }
+    }
+}
+
+/* Print S as a C string literal.  */
+static void print_quoted __P ((const char *s));
+static void
+print_quoted (s)
+     const char *s;
+{
+  putchar ('"');
+  for (; *s; s++)
+    if (*s == '"' || *s == '\\')
+      printf ("\\%c", *s);
+    else if ((unsigned char)*s < ' ' || (unsigned char)*s > '~')
+      printf ("\\%03o", (unsigned char)*s);
+    else
+      putchar (*s);
+  putchar ('"');
+}
+
+static void print_flags __P ((int flags));
+static void
+print_flags (flags)
+     int flags;
+{
+  static const struct { int bit; const char *name; } names[] = {
+    { FNM_PATHNAME, "FNM_PATHNAME" }, { FNM_NOESCAPE, "FNM_NOESCAPE" },
+    { FNM_PERIOD, "FNM_PERIOD" }, { FNM_LEADING_DIR, "FNM_LEADING_DIR" },
+    { FNM_CASEFOLD, "FNM_CASEFOLD" }
+  };
+  const char *sep = "";
+  int i;
+
+  if (flags == 0)
+    printf ("0");
+  for (i = 0; i < 5; i++)
+    if (flags & names[i].bit)
+      {
+	printf ("%s%s", sep, names[i].name);
+	sep = "|";
+      }
+}
+
+/* Run COUNT random cases under every combination of flags.  Returns
+   the number of distinct minimal divergences from the old matcher and
+   the batch matcher.  */
+static int fuzz __P ((unsigned long count));
+static int
+fuzz (count)
+     unsigned long count;
+{
+  static const char *const outcomes[] = { "match", "no match", "error" };
+  Strings seen;
+  char pattern[128], name[128], key[300];
+  unsigned long i;
+  int reports[NMATCHERS];
+  int against, flags, k;
+
+  memset (&seen, 0, sizeof seen);
+  memset (reports, 0, sizeof reports);
+#ifndef HOST_FNMATCH
+  printf ("no C library fnmatch to compare with\n");
+#endif
+  for (i = 0; i < count; i++)
+    {
+      random_pattern (pattern);
+      random_name (name);
+      for (flags = 0; flags <= ALL_FLAGS; flags++)
+	for (against = 0; against < NMATCHERS; against++)
+	  {
+	    int min_flags = flags;
+	    char min_pattern[128], min_name[128];
+
+#ifndef HOST_FNMATCH
+	    if (against == AGAINST_LIBC)
+	      continue;
+#endif
+	    if (!diverges (against, pattern, name, flags))
+	      continue;
+	    strcpy (min_pattern, pattern);
+	    strcpy (min_name, name);
+	    minimize (against, min_pattern, min_name, &min_flags);
+
+	    /* Report each minimal case once.  */
+	    sprintf (key, "%d %d %s\n%s", against, min_flags, min_pattern,
+		     min_name);
+	    for (k = 0; k < seen.n && strcmp (seen.v[k], key); k++)
+	      ;
+	    if (k < seen.n)
+	      continue;
+	    add_string (&seen, key);
+	    if (++reports[against] > MAX_REPORTS)
+	      continue;
+
+	    printf ("fnmatch (");
+	    print_quoted (min_pattern);
+	    printf (", ");
+	    print_quoted (min_name);
+	    printf (", ");
+	    print_flags (min_flags);
+	    printf ("): %s, but %s says %s\n",
+		    outcomes[outcome (own_fnmatch (min_pattern, min_name,
+						   min_flags))],
+		    matcher_names[against],
+		    outcomes[other_outcome (against, min_pattern, min_name,
+					    min_flags)]);
+	  }
+    }
+  printf ("%lu cases, %d flag combinations each\n", count, ALL_FLAGS + 1);
+  for (against = 0; against < NMATCHERS; against++)
+    {
+#ifndef HOST_FNMATCH
+      if (against == AGAINST_LIBC)
+	continue;
+#endif
+      printf ("%d divergences from %s%s\n", reports[against],
+	      matcher_names[against],
+	      against == AGAINST_LIBC ? " (not counted)" : "");
+    }
+  return reports[AGAINST_BASE] + reports[AGAINST_BATCH];
+}
+
+int
+main (argc, argv)
+     int argc;
+     char *argv[];
+{
+  const char *dirlist = getenv ("MANPATH");
+  unsigned long count = 100000;
+  int bench = 1, check = 1, i;
+
+  progname = argv[0];
+  if (!dirlist)
+    dirlist = "/usr/local/man:/usr/share/man:/usr/man";
+
+  for (i = 1; i < argc; i++)
+    if (strcmp (argv[i], "-b") == 0)
+      check = 0;
+    else if (strcmp (argv[i], "-f") == 0)
+      bench = 0;
+    else if (strcmp (argv[i], "-M") == 0 && i + 1 < argc)
+      dirlist = argv[++i];
+    else if (strcmp (argv[i], "-n") == 0 && i + 1 < argc)
+      count = strtoul (argv[++i], (char **)0, 10);
+    else if (strcmp (argv[i], "-s") == 0 && i + 1 < argc)
+      seed = strtoul (argv[++i], (char **)0, 10);
+    else
+      {
+	fprintf (stderr,
+		 "Usage: %s [-b] [-f] [-M dirlist] [-n count] [-s seed]\n",
+		 progname);
+	return 2;
+      }
+
+  if (bench)
+    benchmark (dirlist);
+  if (check && fuzz (count) > 0)
+    return 1;
+  return 0;
+}
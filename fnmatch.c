@@ -47,15 +47,42 @@
 # include <wctype.h>
 #endif
 
+/* Case folding is done by table lookup: FOLD_TABLE[C] is C as it
+   compares under FNM_CASEFOLD.  The table is filled in from `tolower'
+   the first time FNM_CASEFOLD is used.  ASCII_FOLD is nonzero if it
+   folds the ASCII characters as the C locale does, which is not so in
+   a Turkish locale, for one.  */
+static unsigned char fold_table[256];
+static int fold_tables_ready, ascii_fold;
+
+static void init_fold_tables __P ((void));
+static void
+init_fold_tables ()
+{
+  int c;
+
+  ascii_fold = 1;
+  for (c = 0; c < 256; c++)
+    {
+      fold_table[c] = isupper (c) ? tolower (c) : c;
+      if (c < 0x80
+	  && fold_table[c] != (c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c))
+	ascii_fold = 0;
+    }
+  fold_tables_ready = 1;
+}
+
 /* Comment out all this code if we are using the GNU C Library, and are not
    actually compiling the library itself.  This code is part of the GNU C
    Library, but also included in many other GNU distributions.  Compiling
    and linking in this code is a waste when using the GNU C library
    (especially if it is a shared library).  Rather than having every GNU
    program understand `configure --with-gnu-libc' and omit the object files,
-   it is simpler to just do this in the source for each such file.  */
+   it is simpler to just do this in the source for each such file.
+   fnbench.c defines FNMATCH_ALWAYS to test this code against the
+   library's.  */
 
-#if defined _LIBC || !defined __GNU_LIBRARY__
+#if defined _LIBC || !defined __GNU_LIBRARY__ || defined FNMATCH_ALWAYS
 
 
 # if defined STDC_HEADERS || !defined isascii
@@ -127,50 +154,109 @@ extern char *getenv ();
 extern int errno;
 # endif
 
-/* This function doesn't exist on most systems.  */
-
-# if !defined HAVE___STRCHRNUL && !defined _LIBC
-static char *
-__strchrnul (s, c)
-     const char *s;
-     int c;
-{
-  char *result = strchr (s, c);
-  if (result == NULL)
-    result = strchr (s, '\0');
-  return result;
-}
-# endif
-
 # ifndef internal_function
 /* Inside GNU libc we mark some function in a special way.  In other
    environments simply ignore the marking.  */
 #  define internal_function
 # endif
 
+/* Keep the matcher out of `fnmatch', so that names which fail on
+   their leading characters do not pay for setting up its frame.  */
+# if defined __GNUC__ \
+     && (__GNUC__ > 3 || (__GNUC__ == 3 && __GNUC_MINOR__ >= 1))
+#  define noinline_function __attribute__ ((__noinline__))
+# else
+#  define noinline_function
+# endif
+
+/* Nonzero if C is an ordinary pattern character.  */
+# define IS_LITERAL(c) \
+   ((c) != '\0' && (c) != '?' && (c) != '*' && (c) != '[' && (c) != '\\')
+
+/* Runs of ordinary characters are compared a word at a time.  */
+typedef unsigned long fnm_word;
+# define WORD_ONES	((fnm_word) -1 / 0xff)	/* 0x0101...01 */
+# define WORD_HIGHS	(WORD_ONES * 0x80)	/* 0x8080...80 */
+
+/* Fold the ASCII upper-case letters in W to lower case.  W must not
+   have any of its high bits set, so adding to a byte never carries
+   into the next one.  */
+# define ASCII_FOLD_WORD(w)						      \
+   ((w) | ((((w) + WORD_ONES * (0x80 - 'A'))				      \
+	    & ~((w) + WORD_ONES * (0x80 - 'Z' - 1)) & WORD_HIGHS) >> 2))
+
+/* Return nonzero if the LEN characters at S1 and S2 are equal when
+   compared without regard to case.  Words of ASCII characters are
+   folded a word at a time when FOLD_TABLE folds those the way
+   ASCII_FOLD_WORD does; everything else is left to FOLD_TABLE.  */
+static int casefold_equal __P ((const char *s1, const char *s2, size_t len))
+     internal_function;
+static int
+internal_function
+casefold_equal (s1, s2, len)
+     const char *s1;
+     const char *s2;
+     size_t len;
+{
+  while (ascii_fold && len >= sizeof (fnm_word))
+    {
+      fnm_word w1, w2;
+
+      memcpy (&w1, s1, sizeof w1);
+      memcpy (&w2, s2, sizeof w2);
+      if (((w1 | w2) & WORD_HIGHS) != 0)
+	break;
+      if (w1 != w2 && ASCII_FOLD_WORD (w1) != ASCII_FOLD_WORD (w2))
+	return 0;
+      s1 += sizeof w1;
+      s2 += sizeof w2;
+      len -= sizeof w1;
+    }
+  for (; len > 0; ++s1, ++s2, --len)
+    {
+      if (fold_table[(unsigned char) *s1] != fold_table[(unsigned char) *s2])
+	return 0;
+    }
+  return 1;
+}
+
 /* Match STRING against the filename pattern PATTERN, returning zero if
-   it matches, nonzero if not.  */
+   it matches, nonzero if not.  STRING_END points to the terminating
+   null character of STRING, or is NULL if that is not known yet.  */
 static int internal_fnmatch __P ((const char *pattern, const char *string,
+				  const char *string_end,
 				  int no_leading_period, int flags))
-     internal_function;
+     internal_function noinline_function;
 static int
 internal_function
-internal_fnmatch (pattern, string, no_leading_period, flags)
+internal_fnmatch (pattern, string, string_end, no_leading_period, flags)
      const char *pattern;
      const char *string;
+     const char *string_end;
      int no_leading_period;
      int flags;
 {
   register const char *p = pattern, *n = string;
   register unsigned char c;
 
-/* Note that this evaluates C many times.  */
-# ifdef _LIBC
-#  define FOLD(c) ((flags & FNM_CASEFOLD) ? tolower (c) : (c))
-# else
-#  define FOLD(c) ((flags & FNM_CASEFOLD) && ISUPPER (c) ? tolower (c) : (c))
-# endif
+# define FOLD(c) \
+   ((flags & FNM_CASEFOLD) \
+    ? fold_table[(unsigned char) (c)] : (unsigned char) (c))
 
+  /* The most recent `*' which may still absorb more of STRING: where
+     the pattern resumes after it, the next position to try and the
+     end of the candidate positions, and the element after it (as a
+     folded character, or -1 for a bracket expression).  Retrying from
+     here instead of recursing for every candidate bounds the time by
+     the product of the pattern and string lengths.  */
+  const char *star_p = NULL, *star_n = NULL, *star_endp = NULL;
+  const char *star_string = NULL;
+  int star_nlp = 0, star_c = -1;
+
+  if ((flags & FNM_CASEFOLD) && !fold_tables_ready)
+    init_fold_tables ();
+
+ match:
   while ((c = *p++) != '\0')
     {
       c = FOLD (c);
@@ -179,13 +265,13 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	{
 	case '?':
 	  if (*n == '\0')
-	    return FNM_NOMATCH;
+	    goto fail;
 	  else if (*n == '/' && (flags & FNM_FILE_NAME))
-	    return FNM_NOMATCH;
+	    goto fail;
 	  else if (*n == '.' && no_leading_period
 		   && (n == string
 		       || (n[-1] == '/' && (flags & FNM_FILE_NAME))))
-	    return FNM_NOMATCH;
+	    goto fail;
 	  break;
 
 	case '\\':
@@ -194,30 +280,33 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	      c = *p++;
 	      if (c == '\0')
 		/* Trailing \ loses.  */
-		return FNM_NOMATCH;
+		goto fail;
 	      c = FOLD (c);
 	    }
 	  if (FOLD ((unsigned char) *n) != c)
-	    return FNM_NOMATCH;
+	    goto fail;
 	  break;
 
 	case '*':
+	  if (string_end == NULL)
+	    string_end = n + strlen (n);
+
 	  if (*n == '.' && no_leading_period
 	      && (n == string
 		  || (n[-1] == '/' && (flags & FNM_FILE_NAME))))
-	    return FNM_NOMATCH;
+	    goto fail;
 
 	  for (c = *p++; c == '?' || c == '*'; c = *p++)
 	    {
 	      if (*n == '/' && (flags & FNM_FILE_NAME))
 		/* A slash does not match a wildcard under FNM_FILE_NAME.  */
-		return FNM_NOMATCH;
+		goto fail;
 	      else if (c == '?')
 		{
 		  /* A ? needs to match one character.  */
 		  if (*n == '\0')
 		    /* There isn't another character; no match.  */
-		    return FNM_NOMATCH;
+		    goto fail;
 		  else
 		    /* One character of the string is consumed in matching
 		       this ? wildcard, so *??? won't match if there are
@@ -227,66 +316,57 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	    }
 
 	  if (c == '\0')
-	    /* The wildcard(s) is/are the last element of the pattern.
-	       If the name is a file name and contains another slash
-	       this does mean it cannot match.  */
-	    return ((flags & FNM_FILE_NAME) && strchr (n, '/') != NULL
-		    ? FNM_NOMATCH : 0);
+	    {
+	      /* The wildcard(s) is/are the last element of the pattern.
+		 If the name is a file name and contains another slash
+		 this does mean it cannot match.  */
+	      if ((flags & FNM_FILE_NAME)
+		  && memchr (n, '/', string_end - n) != NULL)
+		goto fail;
+	      return 0;
+	    }
 	  else
 	    {
-	      const char *endp;
-
-	      endp = __strchrnul (n, (flags & FNM_FILE_NAME) ? '/' : '\0');
+	      const char *endp = string_end;
 
-	      if (c == '[')
+	      if (flags & FNM_FILE_NAME)
 		{
-		  int flags2 = ((flags & FNM_FILE_NAME)
-				? flags : (flags & ~FNM_PERIOD));
-
-		  for (--p; n < endp; ++n)
-		    if (internal_fnmatch (p, n,
-					  (no_leading_period
-					   && (n == string
-					       || (n[-1] == '/'
-						   && (flags
-						       & FNM_FILE_NAME)))),
-					  flags2)
-			== 0)
-		      return 0;
+		  endp = (const char *) memchr (n, '/', string_end - n);
+		  if (endp == NULL)
+		    endp = string_end;
 		}
-	      else if (c == '/' && (flags & FNM_FILE_NAME))
+
+	      if (c == '/' && (flags & FNM_FILE_NAME))
 		{
-		  while (*n != '\0' && *n != '/')
-		    ++n;
-		  if (*n == '/'
-		      && (internal_fnmatch (p, n + 1, flags & FNM_PERIOD,
-					    flags) == 0))
-		    return 0;
+		  /* The wildcard stops at the next slash, so there is
+		     only one way to go on.  */
+		  if (endp == string_end)
+		    goto fail;
+		  n = string = endp + 1;
+		  no_leading_period = flags & FNM_PERIOD;
+		  continue;
 		}
+
+	      /* Remember this wildcard, forgetting any earlier one: if
+		 the rest of the pattern cannot match after this point,
+		 letting an earlier `*' absorb more characters cannot
+		 help, since this one could absorb them as well.  */
+	      star_p = p - 1;
+	      if (c == '[')
+		star_c = -1;
 	      else
 		{
-		  int flags2 = ((flags & FNM_FILE_NAME)
-				? flags : (flags & ~FNM_PERIOD));
-
 		  if (c == '\\' && !(flags & FNM_NOESCAPE))
 		    c = *p;
-		  c = FOLD (c);
-		  for (--p; n < endp; ++n)
-		    if (FOLD ((unsigned char) *n) == c
-			&& (internal_fnmatch (p, n,
-					      (no_leading_period
-					       && (n == string
-						   || (n[-1] == '/'
-						       && (flags
-							   & FNM_FILE_NAME)))),
-					      flags2) == 0))
-		      return 0;
+		  star_c = FOLD (c);
 		}
+	      star_n = n;
+	      star_endp = endp;
+	      star_string = string;
+	      star_nlp = no_leading_period;
+	      goto next_star_position;
 	    }
 
-	  /* If we come here no match is possible with the wildcard.  */
-	  return FNM_NOMATCH;
-
 	case '[':
 	  {
 	    /* Nonzero if the sense of the character class is inverted.  */
@@ -298,17 +378,17 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	      posixly_correct = getenv ("POSIXLY_CORRECT") != NULL ? 1 : -1;
 
 	    if (*n == '\0')
-	      return FNM_NOMATCH;
+	      goto fail;
 
 	    if (*n == '.' && no_leading_period && (n == string
 						   || (n[-1] == '/'
 						       && (flags
 							   & FNM_FILE_NAME))))
-	      return FNM_NOMATCH;
+	      goto fail;
 
 	    if (*n == '/' && (flags & FNM_FILE_NAME))
 	      /* `/' cannot be matched.  */
-	      return FNM_NOMATCH;
+	      goto fail;
 
 	    not = (*p == '!' || (posixly_correct < 0 && *p == '^'));
 	    if (not)
@@ -322,7 +402,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 		if (!(flags & FNM_NOESCAPE) && c == '\\')
 		  {
 		    if (*p == '\0')
-		      return FNM_NOMATCH;
+		      goto fail;
 		    c = FOLD ((unsigned char) *p);
 		    ++p;
 
@@ -344,7 +424,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 			if (c1 == CHAR_CLASS_MAX_LENGTH)
 			  /* The name is too long and therefore the pattern
 			     is ill-formed.  */
-			  return FNM_NOMATCH;
+			  goto fail;
 
 			c = *++p;
 			if (c == ':' && p[1] == ']')
@@ -368,7 +448,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 		    wt = IS_CHAR_CLASS (str);
 		    if (wt == 0)
 		      /* Invalid character class name.  */
-		      return FNM_NOMATCH;
+		      goto fail;
 
 		    if (__iswctype (__btowc ((unsigned char) *n), wt))
 		      goto matched;
@@ -390,7 +470,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 		  }
 		else if (c == '\0')
 		  /* [ (unterminated) loses.  */
-		  return FNM_NOMATCH;
+		  goto fail;
 		else
 		  {
 		  normal_bracket:
@@ -407,7 +487,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 			if (!(flags & FNM_NOESCAPE) && cend == '\\')
 			  cend = *p++;
 			if (cend == '\0')
-			  return FNM_NOMATCH;
+			  goto fail;
 
 			if (cold <= fn && fn <= FOLD (cend))
 			  goto matched;
@@ -421,7 +501,7 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	      }
 
 	    if (!not)
-	      return FNM_NOMATCH;
+	      goto fail;
 	    break;
 
 	  matched:
@@ -430,13 +510,13 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 	      {
 		if (c == '\0')
 		  /* [... (unterminated) loses.  */
-		  return FNM_NOMATCH;
+		  goto fail;
 
 		c = *p++;
 		if (!(flags & FNM_NOESCAPE) && c == '\\')
 		  {
 		    if (*p == '\0')
-		      return FNM_NOMATCH;
+		      goto fail;
 		    /* XXX 1003.2d11 is unclear if this is right.  */
 		    ++p;
 		  }
@@ -444,20 +524,35 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
 		  {
 		    do
 		      if (*++p == '\0')
-			return FNM_NOMATCH;
+			goto fail;
 		    while (*p != ':' || p[1] == ']');
 		    p += 2;
 		    c = *p;
 		  }
 	      }
 	    if (not)
-	      return FNM_NOMATCH;
+	      goto fail;
 	  }
 	  break;
 
 	default:
 	  if (c != FOLD ((unsigned char) *n))
-	    return FNM_NOMATCH;
+	    goto fail;
+	  if ((flags & FNM_CASEFOLD) && IS_LITERAL (*p))
+	    {
+	      /* Compare the rest of the run a word at a time.  */
+	      size_t len = 1;
+
+	      while (IS_LITERAL (p[len]))
+		++len;
+	      if (string_end == NULL)
+		string_end = n + 1 + strlen (n + 1);
+	      if ((size_t) (string_end - (n + 1)) < len
+		  || !casefold_equal (p, n + 1, len))
+		goto fail;
+	      p += len;
+	      n += len;
+	    }
 	}
 
       ++n;
@@ -470,7 +565,35 @@ internal_fnmatch (pattern, string, no_leading_period, flags)
     /* The FNM_LEADING_DIR flag says that "foo*" matches "foobar/frobozz".  */
     return 0;
 
-  return FNM_NOMATCH;
+ fail:
+  /* Let the last `*' absorb one more character and try again.  */
+  if (star_p == NULL)
+    return FNM_NOMATCH;
+  n = star_n;
+
+ next_star_position:
+  /* Find the next place where the element after the `*' can match.  */
+  if (star_c >= 0 && (!(flags & FNM_CASEFOLD) || !ISLOWER (star_c)))
+    {
+      /* Only STAR_C itself can start the rest of the match, so let
+	 `memchr' skip to its next occurrence.  */
+      n = (const char *) memchr (n, star_c, star_endp - n);
+      if (n == NULL)
+	return FNM_NOMATCH;
+    }
+  else if (star_c >= 0)
+    while (n < star_endp && FOLD ((unsigned char) *n) != star_c)
+      ++n;
+  if (n >= star_endp)
+    return FNM_NOMATCH;
+
+  p = star_p;
+  star_n = n + 1;
+  no_leading_period = (star_nlp
+		       && (n == star_string
+			   || (n[-1] == '/' && (flags & FNM_FILE_NAME))));
+  string = n;
+  goto match;
 
 # undef FOLD
 }
@@ -482,7 +605,191 @@ fnmatch (pattern, string, flags)
      const char *string;
      int flags;
 {
-  return internal_fnmatch (pattern, string, flags & FNM_PERIOD, flags);
+  const char *p = pattern, *n = string;
+  int no_leading_period = flags & FNM_PERIOD;
+
+  /* Most names are told apart from the pattern by its leading
+     ordinary characters.  Compare those here, before the matcher sets
+     up its frame and state; the table is not there before the
+     matcher's first FNM_CASEFOLD call.  */
+  if (!(flags & FNM_CASEFOLD))
+    {
+      while (IS_LITERAL (*p) && *p == *n)
+	{
+	  ++p;
+	  ++n;
+	}
+      if (IS_LITERAL (*p))
+	return FNM_NOMATCH;
+    }
+  else if (fold_tables_ready)
+    {
+      while (IS_LITERAL (*p)
+	     && fold_table[(unsigned char) *p] == fold_table[(unsigned char) *n])
+	{
+	  ++p;
+	  ++n;
+	}
+      if (IS_LITERAL (*p))
+	return FNM_NOMATCH;
+    }
+
+  /* The matcher takes N for the start of the name, where a period is
+     leading under FNM_PERIOD.  Unless it follows a slash, let the
+     matcher see the whole name instead.  */
+  if (no_leading_period && n > string
+      && !(n[-1] == '/' && (flags & FNM_FILE_NAME)))
+    {
+      p = pattern;
+      n = string;
+    }
+  return internal_fnmatch (p, n, NULL, no_leading_period, flags);
+}
+
+#endif	/* _LIBC or not __GNU_LIBRARY__ or FNMATCH_ALWAYS.  */
+
+#ifndef _LIBC
+
+/* Batch matching.  This is built on top of `fnmatch', so it is needed
+   even when the C library provides that.  */
+
+/* It uses `strlen' and `memcmp', which <strings.h> need not declare.  */
+# if !HAVE_STRING_H && (defined STDC_HEADERS || defined __GNU_LIBRARY__)
+#  include <string.h>
+# endif
+
+/* What can be told about a pattern without running the matcher: the
+   literal text every match begins with, and the length of the
+   shortest name it can match.  */
+struct batch_pattern
+{
+  unsigned char prefix[16];	/* folded under FNM_CASEFOLD */
+  size_t prefix_len;
+  size_t min_len;
+  int fixed_len;	/* nonzero if every match is exactly MIN_LEN long */
+};
+
+static void analyze_pattern __P ((const char *pattern, int flags,
+				  struct batch_pattern *bp));
+static void
+analyze_pattern (pattern, flags, bp)
+     const char *pattern;
+     int flags;
+     struct batch_pattern *bp;
+{
+  const char *p = pattern;
+  int in_prefix = 1;
+
+  bp->prefix_len = 0;
+  bp->min_len = 0;
+  bp->fixed_len = !(flags & FNM_LEADING_DIR);
+  while (*p != '\0')
+    {
+      unsigned char c = *p++;
+
+      if (c == '*')
+	{
+	  in_prefix = bp->fixed_len = 0;
+	  continue;
+	}
+      else if (c == '[')
+	{
+	  /* A bracket expression matches exactly one character, but it
+	     is not worth parsing here; leave the rest to `fnmatch'.  */
+	  bp->min_len++;
+	  bp->fixed_len = 0;
+	  break;
+	}
+      else if (c == '?')
+	in_prefix = 0;
+      else if (c == '\\' && !(flags & FNM_NOESCAPE))
+	{
+	  if (*p == '\0')
+	    {
+	      bp->fixed_len = 0;
+	      break;
+	    }
+	  c = *p++;
+	}
+
+      if (in_prefix && bp->prefix_len < sizeof bp->prefix)
+	bp->prefix[bp->prefix_len++] = (flags & FNM_CASEFOLD
+					? fold_table[c] : c);
+      else
+	in_prefix = 0;
+      bp->min_len++;
+    }
+}
+
+int
+fnmatch_batch (patterns, flags, npatterns, names, count, matches)
+     const char *const *patterns;
+     const int *flags;
+     int npatterns;
+     const char *const *names;
+     int count;
+     unsigned *matches;
+{
+  struct batch_pattern bp[FNM_BATCH_MAX];
+  int i, j, matched = 0;
+
+  if (!fold_tables_ready)
+    init_fold_tables ();
+  if (npatterns > FNM_BATCH_MAX)
+    npatterns = FNM_BATCH_MAX;
+  for (j = 0; j < npatterns; j++)
+    analyze_pattern (patterns[j], flags[j], &bp[j]);
+
+  for (i = 0; i < count; i++)
+    {
+      const char *name = names[i];
+      size_t len = strlen (name);
+
+      matches[i] = 0;
+      for (j = 0; j < npatterns; j++)
+	{
+	  /* Reject by length and leading characters first.  */
+	  if (len < bp[j].min_len
+	      || (bp[j].fixed_len && len != bp[j].min_len))
+	    continue;
+	  if (flags[j] & FNM_CASEFOLD)
+	    {
+	      size_t k;
+
+	      /* The prefix is already folded; only the name needs it.  */
+	      for (k = 0; k < bp[j].prefix_len; k++)
+		if (fold_table[(unsigned char) name[k]] != bp[j].prefix[k])
+		  break;
+	      if (k < bp[j].prefix_len)
+		continue;
+	    }
+	  else if (memcmp (name, bp[j].prefix, bp[j].prefix_len) != 0)
+	    continue;
+
+	  if (fnmatch (patterns[j], name, flags[j]) == 0)
+	    matches[i] |= 1U << j;
+	}
+      if (matches[i])
+	matched++;
+    }
+  return matched;
+}
+
+/* Store NAME in KEY folded the way FNM_CASEFOLD compares it, so names
+   which match each other under FNM_CASEFOLD get identical keys.  KEY
+   must have room for strlen (NAME) + 1 characters.  Returns KEY.  */
+char *
+fnmatch_fold_key (key, name)
+     char *key;
+     const char *name;
+{
+  char *k = key;
+
+  if (!fold_tables_ready)
+    init_fold_tables ();
+  while ((*k++ = fold_table[(unsigned char) *name++]) != '\0')
+    ;
+  return key;
 }
 
-#endif	/* _LIBC or not __GNU_LIBRARY__.  */
+#endif	/* not _LIBC */
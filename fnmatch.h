@@ -77,6 +77,22 @@ extern "C" {
 extern int fnmatch __P ((__const char *__pattern, __const char *__name,
 			 int __flags));
 
+/* Maximum number of patterns `fnmatch_batch' accepts at once.  */
+#define	FNM_BATCH_MAX	16
+
+/* Match each of the COUNT strings in NAMES against the NPATTERNS
+   patterns in PATTERNS, using FLAGS[J] with pattern J.  Bit J of
+   MATCHES[I] is set if NAMES[I] matches PATTERNS[J].  Returns the
+   number of names which matched at least one pattern.  */
+extern int fnmatch_batch __P ((__const char *__const *__patterns,
+			       __const int *__flags, int __npatterns,
+			       __const char *__const *__names, int __count,
+			       unsigned *__matches));
+
+/* Store NAME in KEY folded the way FNM_CASEFOLD compares characters,
+   for use as a case-insensitive lookup key.  Returns KEY.  */
+extern char *fnmatch_fold_key __P ((char *__key, __const char *__name));
+
 #ifdef	__cplusplus
 }
 #endif
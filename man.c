@@ -60,7 +60,11 @@
 #include <ctype.h>
 #include <errno.h>
 #include <limits.h>
+#include <time.h>
+#include <math.h>
 #include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 #ifdef __TURBOC__
 # include <io.h>
 # include <dir.h>
@@ -82,8 +86,19 @@
 #ifdef __WIN32__
 # include <windows.h>
 # include <malloc.h>
+# include <process.h>
 #endif	 /* __WIN32__ */
 
+#if !defined (MSDOS) && !defined (__WIN32__)
+# include <fcntl.h>
+# include <signal.h>
+# include <sys/mman.h>
+# include <sys/resource.h>
+# include <sys/select.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+#endif
+
 #ifdef __TURBOC__
 # define MATCHFLAGS FNM_CASEFOLD
 #else
@@ -99,6 +114,7 @@ static const char *version = "1.4";
    from `system' library function when the shell is COMMAND.COM.  */
 static char *pager    = "less.exe -c";
 static char *groff    = "groff.exe -man -Tascii";
+static char *html_groff = "groff.exe -man -Thtml";
 # ifdef __DJGPP__
 static char *manpath  = "c:/djgpp/man;c:/djgpp/info;/usr/man";
 # else
@@ -106,22 +122,31 @@ static char *manpath  = "/man;/usr/man";
 # endif
 # define PATH_SEP	';'
 # define IS_DIR_SEP(x)	((x) == '/' || (x) == '\\')
+# define NULL_DEVICE	"NUL"
 
 #else  /* not MSDOS */
 
 # ifdef __WIN32__
 static char *pager    = "less.exe -c";
 static char *groff    = "groff.exe -man -Tascii";
+static char *html_groff = "groff.exe -man -Thtml";
 static char *manpath  = "c:/usr/man;c:/usr/info;/usr/man";
 #  define PATH_SEP	';'
 #  define IS_DIR_SEP(x)	((x) == '/' || (x) == '\\')
+#  define NULL_DEVICE	"NUL"
+#  define MOVE_CMD	"move /y"
+#  define JOB_THEN	"&"
 
 # else	/* not __WIN32__ */
 static char *pager    = "less -c";
 static char *groff    = "groff -man -Tascii";
+static char *html_groff = "groff -man -Thtml";
 static char *manpath  = "/usr/local/man:/usr/share/man:/usr/man";
 #  define PATH_SEP   ':'
 #  define IS_DIR_SEP(x)	((x) == '/')
+#  define NULL_DEVICE	"/dev/null"
+#  define MOVE_CMD	"mv -f"
+#  define JOB_THEN	";"
 
 # endif	 /* not __WIN32__ */
 #endif /* not MSDOS */
@@ -196,11 +221,22 @@ typedef struct {
   char *name;		 /* pointer into PATH where its basename begins */
   int section;		 /* numerical section code */
   unsigned flags;	 /* various prperties, see definitions above */
+  unsigned long key;	 /* section and format, packed for sorting */
+  unsigned long order;	 /* when the page was found */
 } Man_page;
 
 static Man_page **pages; /* array that holds man pages we've found so far */
 static int max_pages;	 /* how much slots do we have in PAGES array? */
 static int next_slot;	 /* the index of the next slot to be used */
+static unsigned long pages_found; /* how many pages were found in all */
+
+/* What to do with the pages `try_directory' finds.  */
+#define KEEP_ALL	0	/* store them all */
+#define KEEP_FIRST	1	/* store only the one which sorts first */
+#define LIST_PAGES	2	/* list each one at once, store none */
+#define KEEP_DISTINCT	3	/* store all, but each file only once */
+#define MATCH_REGEX	4	/* print those matching --regex, store none */
+static int page_mode;
 
 /* Add a page to the list of stored pages.  */
 void
@@ -208,10 +244,14 @@ add_page (Man_page *page)
 {
   if (next_slot >= max_pages)
     {
-      /* Time to realloc.  I believe this won't be called more than once.  */
-      max_pages += 2 * 3;  /* catN + manN times 3 pages per topic */
+      /* Doubling keeps `man -l "*"' on a big tree from copying the
+	 array over and over.  */
+      max_pages = max_pages ? 2 * max_pages : 8;
       pages = (Man_page **)xrealloc (pages, max_pages * sizeof (Man_page *));
     }
+  page->key = (unsigned long)page->section * (FMT_MASK + 1)
+	      + (page->flags & FMT_MASK);
+  page->order = pages_found++;
   pages[next_slot++] = page;
   if (debugging_output)
     fprintf (stderr, "Added page `%s'\n", page->path);
@@ -246,10 +286,12 @@ compare_pages (const void *p1, const void *p2)
   /* FIXME: do we need name comparison as well?  I don't think so.  */
   const Man_page *t1 = *(const Man_page **)p1, *t2 = *(const Man_page **)p2;
 
-  /* First section numbers, then formatting requirements.
-     Sort into descending order, so we could unwind the list from the end.  */
-  return (t2->section - t1->section) * 100
-	 + (t2->flags & FMT_MASK) - (t1->flags & FMT_MASK);
+  /* First section numbers, then formatting requirements, both in the
+     key.  Sort into descending order, so we could unwind the list from
+     the end.  Pages which tie stay in the order they were found in.  */
+  if (t1->key != t2->key)
+    return t1->key < t2->key ? 1 : -1;
+  return t1->order < t2->order ? -1 : t1->order > t2->order;
 }
 
 void
@@ -260,15 +302,195 @@ sort_pages (void)
 
 /* Page display stuff.  */
 
+/* Filtering the formatted output.
+
+   The formatters mark bold text by overstriking each character with
+   itself, "c\bc", and underlined text by overstriking an underscore,
+   "_\bc".  With --plain, only the last character of each overstrike
+   is kept; with --ansi, overstrikes become SGR escape sequences.  */
+
+#define FILTER_NONE	0
+#define FILTER_PLAIN	1
+#define FILTER_ANSI	2
+
+#define STYLE_BOLD	1
+#define STYLE_UNDERLINE	2
+
+/* What --plain or --ansi asked for.  */
+int output_filter;
+
+typedef struct {
+  int mode;		/* FILTER_PLAIN or FILTER_ANSI */
+  FILE *out;
+  int style;		/* the style the output is in */
+  int held;		/* the last character, not written yet, or -1 */
+  int held_style;
+  int after_bs;		/* non-zero if the last byte was a backspace */
+} Overstrike_filter;
+
+/* Switch the output of F to STYLE.  */
+void
+set_style (Overstrike_filter *f, int style)
+{
+  if (f->mode != FILTER_ANSI || style == f->style)
+    return;
+  if (f->style)
+    fputs ("\033[0m", f->out);
+  if (style == (STYLE_BOLD | STYLE_UNDERLINE))
+    fputs ("\033[1;4m", f->out);
+  else if (style == STYLE_BOLD)
+    fputs ("\033[1m", f->out);
+  else if (style == STYLE_UNDERLINE)
+    fputs ("\033[4m", f->out);
+  f->style = style;
+}
+
+void
+write_held (Overstrike_filter *f)
+{
+  if (f->held >= 0)
+    {
+      set_style (f, f->held_style);
+      putc (f->held, f->out);
+      f->held = -1;
+    }
+}
+
+/* Pass the N bytes at BUF through F.  A character is held back until
+   the next byte shows whether it is overstruck; runs of characters
+   between backspaces are written in one go.  */
+void
+filter_overstrikes (Overstrike_filter *f, const char *buf, size_t n)
+{
+  const char *p = buf, *end = buf + n;
+
+  while (p < end)
+    {
+      const char *bs;
+
+      if (f->after_bs)
+	{
+	  int c = (unsigned char)*p++;
+
+	  f->after_bs = 0;
+	  if (f->held < 0)	/* nothing to overstrike */
+	    f->held_style = 0;
+	  else if (f->held == '_' && c != '_')
+	    f->held_style |= STYLE_UNDERLINE;
+	  else
+	    f->held_style |= STYLE_BOLD;
+	  f->held = c;
+	  continue;
+	}
+
+      bs = (const char *)memchr (p, '\b', end - p);
+      if (bs != p)
+	{
+	  const char *run_end = bs ? bs : end;
+
+	  write_held (f);
+	  if (run_end - p > 1)
+	    {
+	      set_style (f, 0);
+	      fwrite (p, 1, run_end - p - 1, f->out);
+	    }
+	  f->held = (unsigned char)run_end[-1];
+	  f->held_style = 0;
+	  p = run_end;
+	}
+      if (p < end)	/* at a backspace */
+	{
+	  f->after_bs = 1;
+	  p++;
+	}
+    }
+}
+
+/* Write out whatever F holds back.  */
+void
+finish_filter (Overstrike_filter *f)
+{
+  write_held (f);
+  set_style (f, 0);
+}
+
+/* Run FORMATTER on FILE, or if FORMATTER is null, read FILE, and pass
+   the result through the overstrike filter to the pager or stdout.  */
+int
+filter_page (const char *file, const char *formatter)
+{
+  char buf[BUFSIZ * 4];
+  char *cmd = (char *)0;
+  FILE *in, *out;
+  Overstrike_filter f;
+  size_t n;
+  int status = 0;
+
+  if (formatter)
+    {
+      cmd = (char *)alloca (strlen (formatter) + strlen (file) + 4);
+      sprintf (cmd, "%s \"%s\"", formatter, file);
+      if (debugging_output)
+	fprintf (stderr, "Running `%s'\n", cmd);
+      in = popen (cmd, "r");
+    }
+  else
+    in = fopen (file, "rb");
+  if (!in)
+    {
+      fprintf (stderr, "%s: %s: %s\n", progname, cmd ? cmd : file,
+	       strerror (errno));
+      return -1;
+    }
+  out = direct_output ? stdout : popen (pager, "w");
+  if (!out)
+    {
+      fprintf (stderr, "%s: %s: %s\n", progname, pager, strerror (errno));
+      if (cmd)
+	pclose (in);
+      else
+	fclose (in);
+      return -1;
+    }
+
+  f.mode = output_filter;
+  f.out = out;
+  f.style = 0;
+  f.held = -1;
+  f.held_style = 0;
+  f.after_bs = 0;
+  while ((n = fread (buf, 1, sizeof buf, in)) > 0)
+    filter_overstrikes (&f, buf, n);
+  finish_filter (&f);
+
+  if (cmd)
+    status = pclose (in);
+  else
+    fclose (in);
+  if (out != stdout)
+    pclose (out);
+  else
+    fflush (stdout);
+  if (verbose_option && status)
+    fprintf (stderr, "%s: `%s' returned %d\n", progname, cmd, status);
+  return status;
+}
+
 /* Pipe the page through a formatter (if needed) to a pager.  */
 int
 display_page (const char *file, const char *formatter)
 {
-  size_t cmdlen = (formatter ? strlen (formatter) + 3 : 0) +
-		  strlen (file) + 1 + strlen (pager) + 1;
-  char *cmd = (char *)alloca (cmdlen);
+  size_t cmdlen;
+  char *cmd;
   int status;
 
+  if (output_filter)
+    return filter_page (file, formatter);
+
+  /* Room for the quotes, blanks and " | " around the names.  */
+  cmdlen = (formatter ? strlen (formatter) + 6 : 3) +
+	   strlen (file) + strlen (pager) + 1;
+  cmd = (char *)alloca (cmdlen);
   if (formatter)
     {
       /* "groff -man -Tascii /usr/man/foo.1 | less -c"  */
@@ -373,12 +595,13 @@ set_section (const char *basename)
   return secno;
 }
 
-/* Compute the formatting flags for a page by reading its first line.  */
+/* Compute the formatting flags for the page FILE by reading its first
+   line from FP, which is then closed.  FP is null if FILE could not be
+   opened.  */
 unsigned
-set_flags (const char *file)
+read_flags (FILE *fp, const char *file)
 {
   char line[10];
-  FILE *fp = fopen (file, "rt");
   unsigned retval = 0;
 
   if (!fp || !fgets (line, 10, fp))
@@ -422,11 +645,18 @@ set_flags (const char *file)
   else
     retval = FLAG_UNFORMATTED;
 
-  if (fclose (fp))
+  if (fp && fclose (fp))
     retval = FLAG_CANT_OPEN;	/* CANT_OPEN is a misnomer, actually */
   return retval;
 }
 
+/* Compute the formatting flags for a page by reading its first line.  */
+unsigned
+set_flags (const char *file)
+{
+  return read_flags (fopen (file, "rt"), file);
+}
+
 int
 isadir(char *fn)
 {
@@ -442,261 +672,7222 @@ isadir(char *fn)
 
 char dir_pattern1[5], dir_pattern2[5];
 
-/*  Find all man page files in directory DIR and, if RECURSE_OK is
-    set, in its first-level subdirectories man* and cat*.
-    Returns the number of found pages, or -1 in case of fatal errors.  */
-int
-try_directory (const char *dir, const char *file_pattern, int recurse_ok)
+/* Locale subtrees.
+
+   A MANPATH directory may hold translated pages in subtrees named
+   after locales, like "de/man1" or "pt_BR/man8".  The candidate
+   locales come from the -L option or the environment, most specific
+   first: "de_DE.UTF-8@euro", "de_DE" and "de".  Which of them exist
+   under a MANPATH directory is found out once per run.  */
+
+#define MAX_LOCALES	3
+
+static char *locale_names[MAX_LOCALES];
+static int nlocales;
+
+/* The locale subtrees found under each MANPATH directory.  */
+typedef struct locale_dirs {
+  char *top;
+  unsigned present;	/* bit I set if LOCALE_NAMES[I] is there */
+  struct locale_dirs *next;
+} Locale_dirs;
+
+static Locale_dirs *locale_dirs;
+
+/* Add the first LEN characters of NAME to the candidate locales,
+   unless it is the last one added already.  */
+void
+add_locale (const char *name, size_t len)
 {
-  size_t dirlen = strlen (dir);
-  DIR *dp = opendir (dir);
-  struct dirent *de;
-  int found = 0;
-  char cat_name[PATH_MAX];
-  int try_cat_dir = 0;
-  char entry_name[PATH_MAX];
+  if (len == 0
+      || (nlocales > 0 && strlen (locale_names[nlocales - 1]) == len
+	  && strncmp (locale_names[nlocales - 1], name, len) == 0))
+    return;
+  locale_names[nlocales] = (char *)xmalloc (len + 1);
+  memcpy (locale_names[nlocales], name, len);
+  locale_names[nlocales++][len] = '\0';
+}
 
-  if (!dp)
+/* Set the candidate locales from LOCALE, or from the environment if
+   LOCALE is null.  */
+void
+set_locales (const char *locale)
+{
+  static const char *vars[] = { "LC_ALL", "LC_MESSAGES", "LANG" };
+  int i;
+
+  /* Forget the old candidates and what we found out about them.  */
+  while (nlocales > 0)
+    free (locale_names[--nlocales]);
+  while (locale_dirs)
     {
-      if (verbose_option)
-	fprintf (stderr, "%s: cannot look inside %s: %s\n",
-		 progname, dir, strerror (errno));
-      return -1;
+      Locale_dirs *next = locale_dirs->next;
+
+      free (locale_dirs->top);
+      free (locale_dirs);
+      locale_dirs = next;
     }
 
-  if (debugging_output)
-    fprintf (stderr, "Looking in `%s' for `%s'\n", dir, file_pattern);
+  for (i = 0; !locale && i < 3; i++)
+    if ((locale = getenv (vars[i])) != 0 && !*locale)
+      locale = (char *)0;
+  if (!locale || strcmp (locale, "C") == 0 || strcmp (locale, "POSIX") == 0)
+    return;
 
-  if (!recurse_ok
-#ifdef __TURBOC__
-      && strnicmp (dir + dirlen - 5, "/man", 4) == 0
-#else
-      && strncmp (dir + dirlen - 5, "/man", 4) == 0
-#endif
-      && strchr (section_letters, dir[dirlen-1]))
+  add_locale (locale, strlen (locale));
+  add_locale (locale, strcspn (locale, ".@"));
+  add_locale (locale, strcspn (locale, "_.@"));
+}
+
+/* Non-zero if NAME looks like the name of a locale subtree: two or
+   three lower-case letters, perhaps followed by a territory, codeset
+   or modifier.  */
+int
+is_locale_name (const char *name)
+{
+  size_t len = 0;
+
+  while (len < 4 && islower ((unsigned char)name[len]))
+    len++;
+  return ((len == 2 || len == 3)
+	  && (name[len] == '\0' || strchr ("_.@", name[len])));
+}
+
+/* Return the set of candidate locales which have a subtree under the
+   MANPATH directory TOP.  */
+unsigned
+locale_subtrees (const char *top)
+{
+  Locale_dirs *ld;
+  char path[FILENAME_MAX];
+  int i;
+
+  if (nlocales == 0)
+    return 0;
+  for (ld = locale_dirs; ld; ld = ld->next)
+    if (strcmp (ld->top, top) == 0)
+      return ld->present;
+
+  ld = (Locale_dirs *)xmalloc (sizeof (Locale_dirs));
+  ld->top = strcpy ((char *)xmalloc (strlen (top) + 1), top);
+  ld->present = 0;
+  for (i = 0; i < nlocales; i++)
     {
-      try_cat_dir = 1;
-      /* Create a name of the sibling catN directory.  */
-      memcpy (cat_name, dir, dirlen - 4);
-      memcpy (cat_name + dirlen - 4, "cat", 3);
-      cat_name[dirlen - 1] = dir[dirlen - 1];
-      cat_name[dirlen] = '/';
+      sprintf (path, "%s/%s", top, locale_names[i]);
+      if (isadir (path))
+	ld->present |= 1 << i;
     }
+  if (debugging_output)
+    fprintf (stderr, "Locale subtrees of `%s': %#x\n", top, ld->present);
+  ld->next = locale_dirs;
+  locale_dirs = ld;
+  return ld->present;
+}
 
-  strcat (strcpy (entry_name, dir), "/");
-  while ((de = readdir (dp)) != 0)
-    {
-      strcpy (entry_name + dirlen + 1, de->d_name);
+/* The directory index.
 
-      /* If found a subdirectory like manN or catN, recurse into it.  */
-      if (recurse_ok &&
-#ifdef __TURBOC__
-	  (de->d_name[0] == 'm' || de->d_name[0] == 'c'
-	   || de->d_name[0] == 'M' || de->d_name[0] == 'C')
-#else
-	  (de->d_name[0] == 'm' || de->d_name[0] == 'c')
-#endif
-	  && (fnmatch (dir_pattern1, de->d_name, 0) == 0
-	      || fnmatch (dir_pattern2, de->d_name, MATCHFLAGS) == 0))
-	{
-	  if (isadir (entry_name))
-	    {
-	      if (debugging_output)
-		fprintf (stderr, "`%s': a directory, recursing\n", entry_name);
-	      found += try_directory (entry_name, file_pattern, 0);
-	    }
-	}
-      else if (fnmatch (file_pattern, de->d_name, MATCHFLAGS) == 0)
-	{
-	  char *full_name;
-	  Man_page *page;
+   `man -u' records the names in the manN and catN subdirectories of
+   each MANPATH directory in a file INDEX_NAME at the top of that
+   directory.  A lookup takes the names of a subdirectory from the
+   index instead of reading the subdirectory, as long as its device,
+   inode and modification time are still those recorded with the
+   names.  Updating an index re-reads only the subdirectories which
+   changed since it was written.  The new index is written under a
+   temporary name and renamed over the old one, so a lookup running at
+   the same time reads either the old index or the new one.
 
-	  /* If a file by the same name exists in a sibling catN directory,
-	     don't add the file from manN directory to the list, because
-	     the formatted file from the catN directory will be used.  */
-	  if (try_cat_dir)
-	    {
-	      strcpy (cat_name + dirlen + 1, de->d_name);
-	      if (access (cat_name, R_OK) == 0 && isadir (cat_name))
-		{
-		  if (debugging_output)
-		    fprintf (stderr,
-			     "`%s': rejected (formatted version found)\n",
-			     entry_name);
-		  continue;
-		}
-	    }
+   The top directory itself is not indexed: writing the index changes
+   it, so it would never look current.  It is usually small anyway.  */
 
-#ifdef __TURBOC__
-	  full_name = (char *)xmalloc (dirlen + strlen(de->d_name) + 2);
-#else
-	  full_name = (char *)xmalloc (dirlen + de->d_namlen + 2);
-#endif
-	  page  = (Man_page *)xmalloc (sizeof (Man_page));
+#define INDEX_NAME	"man.idx"
+#define INDEX_TEMP	"man.id~"
+#define INDEX_MAGIC	"man index 1\n"
+#define FTS_NAME	"man.fts"	/* the full-text index; see below */
+#define FTS_TEMP	"man.ft~"
+#define XRF_NAME	"man.xrf"	/* the cross-reference index */
+#define XRF_TEMP	"man.xr~"
+#define ALS_NAME	"man.als"	/* the alias index */
+#define ALS_TEMP	"man.al~"
 
-	  if (debugging_output)
-	    fprintf (stderr, "`%s': accepted\n", entry_name);
-	  strcpy (full_name, entry_name);
-	  page->path = full_name;
-	  page->name = full_name + dirlen + 1;
-	  page->section = set_section (page->name);
-	  page->flags = set_flags (full_name);
-	  found++;
-	  add_page (page);
-	}
+/* Non-zero if NAME is one of the index files.  */
+#define is_index_file(name)					\
+  (strcmp ((name), INDEX_NAME) == 0 || strcmp ((name), INDEX_TEMP) == 0 \
+   || strcmp ((name), FTS_NAME) == 0 || strcmp ((name), FTS_TEMP) == 0 \
+   || strcmp ((name), XRF_NAME) == 0 || strcmp ((name), XRF_TEMP) == 0 \
+   || strcmp ((name), ALS_NAME) == 0 || strcmp ((name), ALS_TEMP) == 0)
+
+/* The names in one directory of a MANPATH tree.  */
+typedef struct {
+  const char *name;	 /* relative to the top, e.g. "man1" */
+  unsigned long dev;	 /* identity of the directory when it was read */
+  unsigned long ino;
+  unsigned long mtime;
+  int count;		 /* how many names there are */
+  char **names;
+  char *storage;	 /* the names, unless they live in the index text */
+} Dir_listing;
+
+/* The index of one MANPATH directory.  */
+typedef struct man_index {
+  char *top;		 /* the MANPATH directory */
+  Dir_listing *dirs;	 /* its listings; none if it has no index */
+  int ndirs;
+  char *text;		 /* contents of the index file */
+  struct man_index *next;
+} Man_index;
+
+static Man_index *indexes;	  /* the indices read so far */
+static Man_index *current_index;  /* index of the tree being searched */
+
+/* Copy the next directory from the MANPATH-style list at *LIST into
+   DIR and advance *LIST past it.  Returns zero at the end of LIST.  */
+int
+next_path_dir (const char **list, char *dir)
+{
+  const char *start = *list, *end;
+
+  while (start)
+    {
+      dir[0] = '\0';	/* so we could use `strncat' */
+      if (*start == PATH_SEP)
+	start++;
+      end = strchr (start, PATH_SEP);
+      if (end)
+	/* `strncat' frees us from worrying about terminating null char.  */
+	strncat (dir, start, end - start);
+      else
+	strcpy (dir, start);
+      *list = start = end;
+      if (dir[0])
+	return 1;
     }
-  closedir (dp);
-  return found;
+  return 0;
 }
 
+/* Get the identity of directory DIR.  Returns zero on success.  */
 int
-find_pages (const char *section, const char *name)
+dir_identity (const char *dir, unsigned long *dev, unsigned long *ino,
+	      unsigned long *mtime)
 {
-  char this_dir[FILENAME_MAX], file_pattern[FILENAME_MAX];
-  char base[FILENAME_MAX], ext[10];
-  const char *dstart, *dend;
-  int found_pages = 0;
-  size_t namelen = strlen (name);
-  size_t extlen = 0;
-#ifdef MSDOS
-  int truncate_long_names = 1;
-#else  /* not MSDOS */
-  int truncate_long_names = 0;
-#endif /* not MSDOS */
+  struct stat st;
 
-  /* Look in either "manN" and "catN" or "man?" and "cat?" subdirs.  */
-  dir_pattern1[3] = dir_pattern2[3] = (*section == '*' ? '?' :  *section);
+  if (stat (dir, &st))
+    return -1;
+  *dev = (unsigned long)st.st_dev;
+  *ino = (unsigned long)st.st_ino;
+  *mtime = (unsigned long)st.st_mtime;
+  return 0;
+}
 
-  /* Generate the pattern "name.section"  */
-  memcpy (base, name, namelen + 1);
-  ext[extlen++] = '.';
+/* Probing MANPATH directories.
 
-  /* "foo" + "3"  -> "foo.3*"
-     "foo" + "3v" -> "foo.3v"
-     "foo" + "new" -> "foo.[1-9]?"
-     "foo" + "*"  -> "foo.[!iz]*"  (so we don't find .info and .zip files)  */
-  if (isdigit (*section))
-    {
-      ext[extlen++] = *section++;
-      if (*section)
-	ext[extlen++] = *section;
-      else
-	ext[extlen++] = '*';
-      ext[extlen++] = '\0';
-    }
-  else if (strchr (section_letters, *section))
-    strcpy (ext + extlen, "[1-9]?");
-  else
-    strcpy (ext + extlen, "[!iz]*");
+   A directory on a dead network mount can make `opendir' or even
+   `stat' hang.  With --deadline MS, every MANPATH directory is probed
+   before it is searched: all of them are read at once, by child
+   processes on Unix and by threads on Windows, and those which have
+   not answered MS milliseconds after the probes began are left out of
+   this run.  They are written down in the file SLOW_NAME in the
+   private directory, and left out without probing for SLOW_SECONDS
+   after that.  DOS cannot probe asynchronously; there, all the
+   directories are searched.  */
 
-  /* Try each directory in MANPATH.  */
-  for (dstart = manpath; dstart; dstart = dend)
-    {
-      this_dir[0] = '\0';	/* so we could use `strncat' */
-      if (*dstart == PATH_SEP)
-	dstart++;
-      dend = strchr (dstart, PATH_SEP);
-      if (dend)
-	/* `strncat' frees us from worrying about terminating null char.  */
-	strncat (this_dir, dstart, dend - dstart);
-      else if (strlen (dstart) > 0)
-	strcpy (this_dir, dstart);
+#define SLOW_NAME	"manslow.dat"
+#define SLOW_SECONDS	60
 
-      if (this_dir[0])
-	{
-	  int this_found;
+/* How long to wait for a MANPATH directory, or 0 not to probe.  */
+static long probe_deadline;
 
-#ifdef __DJGPP__
-	  /* DJGPP's support of long file names depends on whether the
-	     filesystem where THIS_DIR resides supports long names.  */
-	  truncate_long_names = !_use_lfn (this_dir);
+/* The directory for temporary files.  */
+const char *
+temp_dir (void)
+{
+  const char *dir = getenv ("TMPDIR");
+
+  if (!dir)
+    dir = getenv ("TMP");
+  if (!dir)
+    dir = getenv ("TEMP");
+  if (!dir)
+#if defined (MSDOS) || defined (__WIN32__)
+    dir = ".";
+#else
+    dir = "/tmp";
 #endif
-	  /* If NAME is longer than 8 characters, we will never find it using
-	     `fnmatch' if file names are truncated by the filesystem.  We
-	     need to truncate the topic name as well.  */
-	  if (truncate_long_names && namelen > 8)
-	    {
-	      file_pattern[0] = '\0';
-	      strncat (file_pattern, base, 8);
-	    }
-	  else
-	    strcpy (file_pattern, base);
+  return dir;
+}
+
+/* The directory for the files man keeps from one run to the next, and
+   for its temporary files.  On Unix this is "man-UID" in the temporary
+   directory, made for the user alone, so that nobody else can plant
+   files or symlinks in it; elsewhere it is the temporary directory.
+   Returns NULL if it cannot be made, or is not the user's own; then
+   nothing is kept.  */
+const char *
+private_dir (void)
+{
+#if !defined (MSDOS) && !defined (__WIN32__)
+  static char dir[FILENAME_MAX];
+  static int usable;		/* 1 if DIR is, -1 if not, 0 until known */
+  struct stat st;
 
-	  strcat (file_pattern, ext);
+  if (usable == 0)
+    {
+      const char *temp = temp_dir ();
 
-	  this_found = try_directory (this_dir, file_pattern, 1);
-	  if (this_found > 0)
-	    found_pages += this_found;
+      usable = -1;
+      if (strlen (temp) + 32 < sizeof dir)
+	{
+	  sprintf (dir, "%s/man-%lu", temp, (unsigned long)getuid ());
+	  mkdir (dir, 0700);
+	  if (lstat (dir, &st) == 0 && S_ISDIR (st.st_mode)
+	      && st.st_uid == getuid () && (st.st_mode & 077) == 0)
+	    usable = 1;
+	  else if (verbose_option)
+	    fprintf (stderr, "%s: %s is not private to you, keeping nothing "
+		     "there\n", progname, dir);
 	}
     }
-  return found_pages;
+  return usable > 0 ? dir : (const char *)0;
+#else
+  return temp_dir ();
+#endif
 }
 
-/* Given a page with its formatting flags, build a Groff command line
-   to format that page.  */
-char *
-build_formatter_cmd (const Man_page *page)
+/* Create a new file in directory DIR, which no other process uses,
+   open it with MODE, and put its name into NAME.  Returns NULL if it
+   cannot be made.  */
+FILE *
+make_temp (const char *dir, char *name, const char *mode)
 {
-  static char fmt_cmd[FILENAME_MAX + 3*5 + 1]; /* 5: known preprocessors */
-  unsigned flags = page->flags;
+#if !defined (MSDOS) && !defined (__WIN32__)
+  FILE *fp;
+  int fd;
 
-  if (flags & FLAG_CANT_OPEN)	/* file couldn't be accessed */
+  sprintf (name, "%s/manXXXXXX", dir);
+  if ((fd = mkstemp (name)) < 0)
+    return (FILE *)0;
+  if ((fp = fdopen (fd, mode)) == 0)
     {
-      fprintf (stderr, "%s: Impossible: %s is inaccessible\n",
-	       progname, page->path);
-      exit (3);
+      close (fd);
+      remove (name);
     }
-  else if (flags & FLAG_FORMATTED)
-    return (char *)0;	/* no formatter required */
-
-  strcpy (fmt_cmd, groff);
-
-  if (flags & FLAG_SOELIM)
-    strcat (fmt_cmd, " -s");	/* I think Groff doesn't need this... */
-  if (flags & FLAG_EQN)
-    strcat (fmt_cmd, " -e");
-  if (flags & FLAG_REFER)
-    strcat (fmt_cmd, " -R");
-  if (flags & FLAG_TBL)
-    strcat (fmt_cmd, " -t");
-  if (flags & FLAG_VGRIND)
-    fprintf (stderr, "%s: vgrind preprocessing not supported!\n",
-	     progname);
+  return fp;
+#else
+  /* There is one user, and the process ID tells this run from the
+     others.  */
+  static int serial;
 
-  return fmt_cmd;
+  sprintf (name, "%s/m%05u%02d.tmp", dir, (unsigned)getpid () % 100000,
+	   serial++ % 100);
+  return fopen (name, mode);
+#endif
 }
 
-/* Display man page(s) for a topic NAME in section SECTION.  */
+/* Rename FROM to TO, replacing TO if it exists.  */
 int
-man_entry (const char *section, const char *name)
+replace_file (const char *from, const char *to)
 {
-  int count = find_pages (section, name);
+#ifdef __WIN32__
+  return MoveFileEx (from, to, MOVEFILE_REPLACE_EXISTING) ? 0 : -1;
+#else
+# ifdef MSDOS
+  /* DOS cannot rename over an existing file.  A lookup in between
+     finds no index and reads the directories.  */
+  remove (to);
+# endif
+  return rename (from, to);
+#endif
+}
 
-  if (count > 0)
-    {
+
+/* Milliseconds since some fixed time.  */
+unsigned long
+now_ms (void)
+{
+#if defined (__WIN32__)
+  return GetTickCount ();
+#elif !defined (MSDOS)
+  struct timeval tv;
+
+  gettimeofday (&tv, (struct timezone *)0);
+  return (unsigned long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#else
+  return (unsigned long)(clock () * 1000.0 / CLOCKS_PER_SEC);
+#endif
+}
+
+/* A probe of one directory under way.  */
+typedef struct {
+  char *dir;
+  int answered;
+#if defined (__WIN32__)
+  HANDLE thread;
+#elif !defined (MSDOS)
+  pid_t pid;
+  int fd;		/* the child closes its end when it is done */
+#endif
+} Probe;
+
+/* Read directory DIR through.  */
+void
+read_through (const char *dir)
+{
+  DIR *dp = opendir (dir);
+
+  if (dp)
+    {
+      while (readdir (dp))
+	;
+      closedir (dp);
+    }
+}
+
+#ifdef __WIN32__
+DWORD WINAPI
+probe_thread (LPVOID dir)
+{
+  read_through ((const char *)dir);
+  return 0;
+}
+#endif
+
+/* Start probing P->dir.  */
+void
+start_probe (Probe *p)
+{
+  p->answered = 0;
+#if defined (__WIN32__)
+  p->thread = CreateThread (NULL, 0, probe_thread, p->dir, 0, NULL);
+  if (p->thread == NULL)
+    p->answered = 1;	/* cannot tell; search it */
+#elif !defined (MSDOS)
+  {
+    int fds[2];
+
+    p->pid = -1;
+    if (pipe (fds))
+      {
+	p->answered = 1;
+	return;
+      }
+    fflush (stdout);
+    fflush (stderr);
+    p->pid = fork ();
+    if (p->pid == 0)
+      {
+	close (fds[0]);
+	read_through (p->dir);
+	_exit (0);
+      }
+    close (fds[1]);
+    p->fd = fds[0];
+    if (p->pid < 0)
+      {
+	close (p->fd);
+	p->answered = 1;
+      }
+  }
+#else
+  p->answered = 1;
+#endif
+}
+
+/* Wait up to MS milliseconds for probe P to answer.  */
+void
+finish_probe (Probe *p, long ms)
+{
+#if defined (__WIN32__)
+  if (p->answered)
+    return;
+  p->answered = WaitForSingleObject (p->thread, ms) == WAIT_OBJECT_0;
+  /* A thread stuck in the file system cannot be stopped; it goes when
+     the program exits.  */
+  CloseHandle (p->thread);
+#elif !defined (MSDOS)
+  fd_set fds;
+  struct timeval tv;
+
+  if (p->pid <= 0)
+    return;
+  FD_ZERO (&fds);
+  FD_SET (p->fd, &fds);
+  tv.tv_sec = ms / 1000;
+  tv.tv_usec = (ms % 1000) * 1000;
+  while ((p->answered = select (p->fd + 1, &fds, NULL, NULL, &tv)) < 0
+	 && errno == EINTR)
+    ;
+  if (p->answered < 0)
+    p->answered = 1;
+  close (p->fd);
+  if (p->answered)
+    waitpid (p->pid, (int *)0, 0);
+  else
+    {
+      /* A child stuck in the file system dies when it comes out.  */
+      kill (p->pid, SIGKILL);
+      waitpid (p->pid, (int *)0, WNOHANG);
+    }
+#endif
+}
+
+/* The directories of the slow list which are still cooling down; the
+   list ends with a null pointer.  Returns NULL if there are none.  */
+char **
+read_slow_list (void)
+{
+  char name[FILENAME_MAX], line[FILENAME_MAX + 32], dir[FILENAME_MAX];
+  char **slow = (char **)0;
+  unsigned long when;
+  time_t now = time ((time_t *)0);
+  const char *private = private_dir ();
+  int n = 0;
+  FILE *fp;
+
+  if (!private)
+    return slow;
+  sprintf (name, "%s/%s", private, SLOW_NAME);
+  fp = fopen (name, "r");
+  if (!fp)
+    return slow;
+  while (fgets (line, sizeof line, fp))
+    if (sscanf (line, "%lu %[^\n]", &when, dir) == 2
+	&& (unsigned long)now < when + SLOW_SECONDS)
+      {
+	slow = (char **)xrealloc (slow, (n + 2) * sizeof (char *));
+	slow[n] = (char *)xmalloc (strlen (dir) + 1);
+	strcpy (slow[n++], dir);
+	slow[n] = (char *)0;
+      }
+  fclose (fp);
+  return slow;
+}
+
+/* Add DIR to the slow list, dropping the entries which cooled down.
+   The new list replaces the old one in one step, so that other runs
+   see either.  */
+void
+add_to_slow_list (const char *dir)
+{
+  char name[FILENAME_MAX], temp[FILENAME_MAX], line[FILENAME_MAX + 32];
+  char *kept = (char *)0;
+  size_t kept_len = 0, len;
+  unsigned long when, now = (unsigned long)time ((time_t *)0);
+  const char *private = private_dir ();
+  FILE *fp;
+
+  if (!private)
+    return;
+  sprintf (name, "%s/%s", private, SLOW_NAME);
+  if ((fp = fopen (name, "r")) != 0)
+    {
+      while (fgets (line, sizeof line, fp))
+	if (sscanf (line, "%lu", &when) == 1 && now < when + SLOW_SECONDS)
+	  {
+	    len = strlen (line);
+	    kept = (char *)xrealloc (kept, kept_len + len + 1);
+	    memcpy (kept + kept_len, line, len + 1);
+	    kept_len += len;
+	  }
+      fclose (fp);
+    }
+  if ((fp = make_temp (private, temp, "w")) != 0)
+    {
+      if (kept)
+	fputs (kept, fp);
+      fprintf (fp, "%lu %s\n", now, dir);
+      if (fclose (fp) || replace_file (temp, name))
+	remove (temp);
+    }
+  free (kept);
+}
+
+/* Remove from the MANPATH-style list ROOTS the directories which are
+   cooling down or do not answer in time.  */
+void
+drop_slow_roots (char *roots)
+{
+  const char *list = roots;
+  char dir[FILENAME_MAX];
+  char **slow = read_slow_list ();
+  Probe *probes = (Probe *)0;
+  unsigned long start;
+  int nprobes = 0, i, j;
+
+  while (next_path_dir (&list, dir))
+    {
+      for (j = 0; slow && slow[j] && strcmp (slow[j], dir); j++)
+	;
+      probes = (Probe *)xrealloc (probes, (nprobes + 1) * sizeof (Probe));
+      probes[nprobes].dir = (char *)xmalloc (strlen (dir) + 1);
+      strcpy (probes[nprobes].dir, dir);
+      probes[nprobes].answered = 0;
+      if (slow && slow[j])
+	{
+	  if (debugging_output)
+	    fprintf (stderr, "`%s': slow a moment ago, skipping\n", dir);
+	  probes[nprobes].answered = -1;
+	}
+      nprobes++;
+    }
+
+  start = now_ms ();
+  for (i = 0; i < nprobes; i++)
+    if (probes[i].answered != -1)
+      start_probe (&probes[i]);
+
+  roots[0] = '\0';
+  for (i = 0; i < nprobes; i++)
+    {
+      if (probes[i].answered != -1)
+	{
+	  long left = probe_deadline - (long)(now_ms () - start);
+
+	  finish_probe (&probes[i], left > 0 ? left : 0);
+	  if (probes[i].answered)
+	    {
+	      if (roots[0])
+		sprintf (roots + strlen (roots), "%c", PATH_SEP);
+	      strcat (roots, probes[i].dir);
+	    }
+	  else
+	    {
+	      if (verbose_option || debugging_output)
+		fprintf (stderr, "%s: %s did not answer in %ld ms, skipping\n",
+			 progname, probes[i].dir, probe_deadline);
+	      add_to_slow_list (probes[i].dir);
+	    }
+	}
+      free (probes[i].dir);
+    }
+  free (probes);
+  for (j = 0; slow && slow[j]; j++)
+    free (slow[j]);
+  free (slow);
+}
+
+/* Put into ID a string which is the same for all the names of
+   directory DIR, so that it can be compared with that of another.  */
+void
+root_identity (const char *dir, char *id)
+{
+#if defined (MSDOS) || defined (__WIN32__)
+  /* Inode numbers are made up or zero here, but there are no links
+     either, so the full path names the directory uniquely.  */
+  char *p;
+
+#ifdef __DJGPP__
+  _fixpath (dir, id);
+#else
+  if (!_fullpath (id, dir, FILENAME_MAX))
+    strcpy (id, dir);
+#endif
+  for (p = id; *p; p++)
+    *p = IS_DIR_SEP (*p) ? '/' : tolower ((unsigned char)*p);
+  if (p > id + 1 && p[-1] == '/' && p[-2] != ':')
+    p[-1] = '\0';
+#else  /* Unix */
+  unsigned long dev, ino, mtime;
+
+  if (dir_identity (dir, &dev, &ino, &mtime) == 0)
+    sprintf (id, "%lu:%lu", dev, ino);
+  else
+    sprintf (id, "?%s", dir);	/* let `try_directory' complain */
+#endif
+}
+
+/* MANPATH without the directories which are the same as one before
+   them, only named differently or through a symlink, so that no tree
+   is searched twice; and with --deadline, without those which do not
+   answer in time.  */
+const char *
+search_roots (void)
+{
+  static const char *roots_of;	/* the MANPATH ROOTS was made from */
+  static char *roots;
+  const char *list;
+  char dir[FILENAME_MAX];
+  char **ids = (char **)0;
+  char *answering;
+  int nids = 0, i;
+
+  if (roots && roots_of == manpath)
+    return roots;
+  free (roots);
+  roots = (char *)xmalloc (strlen (manpath) + 1);
+  roots[0] = '\0';
+
+  /* Even `stat' may hang on a dead mount, so probing comes first.  */
+  answering = (char *)xmalloc (strlen (manpath) + 1);
+  strcpy (answering, manpath);
+  if (probe_deadline > 0)
+    drop_slow_roots (answering);
+  list = answering;
+
+  while (next_path_dir (&list, dir))
+    {
+      char id[FILENAME_MAX + 2];
+
+      root_identity (dir, id);
+      for (i = 0; i < nids && strcmp (ids[i], id); i++)
+	;
+      if (i < nids)
+	{
+	  if (debugging_output)
+	    fprintf (stderr, "`%s': searched already, skipping\n", dir);
+	  continue;
+	}
+      ids = (char **)xrealloc (ids, (nids + 1) * sizeof (char *));
+      ids[nids] = (char *)xmalloc (strlen (id) + 1);
+      strcpy (ids[nids++], id);
+      if (roots[0])
+	sprintf (roots + strlen (roots), "%c", PATH_SEP);
+      strcat (roots, dir);
+    }
+
+  for (i = 0; i < nids; i++)
+    free (ids[i]);
+  free (ids);
+  free (answering);
+  roots_of = manpath;
+  return roots;
+}
+
+/* Non-zero if directory PATH is unchanged since LISTING was read.  */
+int
+listing_is_current (const Dir_listing *listing, const char *path)
+{
+  unsigned long dev, ino, mtime;
+
+  return (dir_identity (path, &dev, &ino, &mtime) == 0
+	  && dev == listing->dev && ino == listing->ino
+	  && mtime == listing->mtime);
+}
+
+/* Find the listing of subdirectory NAME in IDX.  */
+Dir_listing *
+find_listing (const Man_index *idx, const char *name)
+{
+  int i;
+
+  for (i = 0; i < idx->ndirs; i++)
+    if (strcmp (idx->dirs[i].name, name) == 0)
+      return &idx->dirs[i];
+  return (Dir_listing *)0;
+}
+
+/* Read the names in directory PATH into LISTING, whose name should be
+   set already.  Returns zero on success.  */
+int
+read_listing (Dir_listing *listing, const char *path)
+{
+  DIR *dp;
+  struct dirent *de;
+  size_t size = 0, used = 0;
+  int i;
+  char *p;
+  unsigned long started = (unsigned long)time ((time_t *)0);
+
+  listing->count = 0;
+  listing->names = (char **)0;
+  listing->storage = (char *)0;
+  if (dir_identity (path, &listing->dev, &listing->ino, &listing->mtime)
+      || (dp = opendir (path)) == 0)
+    {
+      if (verbose_option)
+	fprintf (stderr, "%s: cannot look inside %s: %s\n",
+		 progname, path, strerror (errno));
+      return -1;
+    }
+  while ((de = readdir (dp)) != 0)
+    {
+      size_t len = strlen (de->d_name) + 1;
+
+      /* Leave out the index itself, and names which would break the
+	 line structure of the index file.  */
+      if (is_index_file (de->d_name) || strchr (de->d_name, '\n'))
+	continue;
+      if (used + len > size)
+	{
+	  size = 2 * size + len + 256;
+	  listing->storage = (char *)xrealloc (listing->storage, size);
+	}
+      memcpy (listing->storage + used, de->d_name, len);
+      used += len;
+      listing->count++;
+    }
+  closedir (dp);
+  /* Modification times have a resolution of a second or two, so a
+     directory changed in the second we read it could change again
+     without its time changing.  Never trust such a listing: lookups
+     will read the directory, and the next update will read it again.  */
+  if (listing->mtime + 2 > started)
+    listing->mtime = 0;
+
+  /* The storage may move while it grows, so point into it only now.  */
+  listing->names = (char **)xmalloc (listing->count * sizeof (char *));
+  for (i = 0, p = listing->storage; i < listing->count; i++)
+    {
+      listing->names[i] = p;
+      p += strlen (p) + 1;
+    }
+  return 0;
+}
+
+/* Free the listings of IDX and forget them.  */
+void
+release_listings (Man_index *idx)
+{
+  int i;
+
+  for (i = 0; i < idx->ndirs; i++)
+    {
+      if (idx->dirs[i].names)
+	free (idx->dirs[i].names);
+      if (idx->dirs[i].storage)
+	free (idx->dirs[i].storage);
+    }
+  if (idx->dirs)
+    free (idx->dirs);
+  if (idx->text)
+    free (idx->text);
+  idx->dirs = (Dir_listing *)0;
+  idx->ndirs = 0;
+  idx->text = (char *)0;
+}
+
+void
+free_index (Man_index *idx)
+{
+  release_listings (idx);
+  free (idx->top);
+  free (idx);
+}
+
+/* Read the index of the MANPATH directory TOP.  Returns an index with
+   no listings if there is none, or if it cannot be used.  */
+Man_index *
+read_index (const char *top)
+{
+  char file[FILENAME_MAX];
+  FILE *fp;
+  long size = -1;
+  char *p, *eol;
+  Man_index *idx = (Man_index *)xmalloc (sizeof (Man_index));
+  int max_dirs = 0;
+
+  idx->top = strcpy ((char *)xmalloc (strlen (top) + 1), top);
+  idx->dirs = (Dir_listing *)0;
+  idx->ndirs = 0;
+  idx->text = (char *)0;
+  idx->next = (Man_index *)0;
+
+  sprintf (file, "%s/%s", top, INDEX_NAME);
+  if ((fp = fopen (file, "rb")) == 0)
+    return idx;
+  /* Read it all at once: the file can be replaced while we read it.  */
+  if (fseek (fp, 0L, SEEK_END) == 0 && (size = ftell (fp)) >= 0
+      && fseek (fp, 0L, SEEK_SET) == 0)
+    {
+      idx->text = (char *)xmalloc (size + 1);
+      if (fread (idx->text, 1, size, fp) != (size_t)size)
+	size = -1;
+    }
+  fclose (fp);
+  if (size < 0)
+    goto bad;
+  idx->text[size] = '\0';
+
+  if (strncmp (idx->text, INDEX_MAGIC, strlen (INDEX_MAGIC)) != 0)
+    goto bad;
+  for (p = idx->text + strlen (INDEX_MAGIC); *p; )
+    {
+      Dir_listing *l;
+      int i, n = 0;
+
+      if (idx->ndirs >= max_dirs)
+	{
+	  max_dirs = 2 * max_dirs + 16;
+	  idx->dirs = (Dir_listing *)xrealloc (idx->dirs,
+					       max_dirs * sizeof (Dir_listing));
+	}
+      l = &idx->dirs[idx->ndirs];
+      l->names = (char **)0;
+      l->storage = (char *)0;
+      if ((eol = strchr (p, '\n')) == 0)
+	goto bad;
+      *eol = '\0';
+      if (sscanf (p, "d %d %lu %lu %lu %n",
+		  &l->count, &l->mtime, &l->dev, &l->ino, &n) < 4
+	  || n == 0 || l->count < 0)
+	goto bad;
+      /* Each name takes at least its newline, so a count which the
+	 rest of the file cannot hold is damage, not a reason to
+	 allocate that much.  */
+      if ((unsigned long)l->count
+	  > (unsigned long)(idx->text + size - (eol + 1)))
+	goto bad;
+      l->name = p + n;
+      idx->ndirs++;
+      p = eol + 1;
+      l->names = (char **)xmalloc ((l->count + 1) * sizeof (char *));
+      for (i = 0; i < l->count; i++)
+	{
+	  if ((eol = strchr (p, '\n')) == 0)
+	    goto bad;
+	  *eol = '\0';
+	  l->names[i] = p;
+	  p = eol + 1;
+	}
+    }
+  if (debugging_output)
+    fprintf (stderr, "Read index `%s' (%d directories)\n", file, idx->ndirs);
+  return idx;
+
+ bad:
+  if (verbose_option)
+    fprintf (stderr, "%s: %s is unusable, ignoring it\n", progname, file);
+  release_listings (idx);
+  return idx;
+}
+
+/* Return the index of the MANPATH directory TOP, reading it the first
+   time it is asked for.  */
+Man_index *
+get_index (const char *top)
+{
+  Man_index *idx;
+
+  for (idx = indexes; idx; idx = idx->next)
+    if (strcmp (idx->top, top) == 0)
+      return idx;
+  idx = read_index (top);
+  idx->next = indexes;
+  indexes = idx;
+  return idx;
+}
+
+/* In --batch mode, many topics are looked up against one snapshot of
+   the MANPATH directories: each directory is read once, the first time
+   a lookup needs it, and its names are kept here.  */
+
+#define SNAPSHOT_BUCKETS 64
+
+typedef struct snapshot_dir {
+  char *path;
+  int readable;		/* zero if PATH is not a directory we can read */
+  Dir_listing listing;
+  struct snapshot_dir *next;
+} Snapshot_dir;
+
+static Snapshot_dir *snapshot[SNAPSHOT_BUCKETS];
+static int use_snapshot;
+
+/* Return the names in directory PATH as of the first time they were
+   asked for, or null if PATH could not be read then.  */
+const Dir_listing *
+snapshot_listing (const char *path)
+{
+  unsigned hash = 0;
+  const char *p;
+  Snapshot_dir *sd;
+
+  for (p = path; *p; p++)
+    hash = hash * 31 + (unsigned char)*p;
+  hash %= SNAPSHOT_BUCKETS;
+  for (sd = snapshot[hash]; sd; sd = sd->next)
+    if (strcmp (sd->path, path) == 0)
+      return sd->readable ? &sd->listing : (Dir_listing *)0;
+
+  sd = (Snapshot_dir *)xmalloc (sizeof (Snapshot_dir));
+  sd->path = strcpy ((char *)xmalloc (strlen (path) + 1), path);
+  sd->listing.name = sd->path;
+  sd->readable = read_listing (&sd->listing, path) == 0;
+  sd->next = snapshot[hash];
+  snapshot[hash] = sd;
+  return sd->readable ? &sd->listing : (Dir_listing *)0;
+}
+
+/* Set up LISTING for subdirectory NAME of TOP, taking it over from the
+   index OLD if the directory did not change, or else reading it.
+   Returns 1 if the directory was read, 0 if not, -1 on failure.  */
+int
+refresh_listing (Man_index *old, const char *top, const char *name,
+		 Dir_listing *listing)
+{
+  char path[FILENAME_MAX];
+  Dir_listing *l = find_listing (old, name);
+
+  sprintf (path, "%s/%s", top, name);
+  if (l && listing_is_current (l, path))
+    {
+      /* The new index owns the names from now on.  */
+      *listing = *l;
+      l->names = (char **)0;
+      l->storage = (char *)0;
+      return 0;
+    }
+  if (debugging_output)
+    fprintf (stderr, "Reading `%s' for the index\n", path);
+  listing->name = name;
+  return read_listing (listing, path) ? -1 : 1;
+}
+
+/* The full-text index.
+
+   `man -u' also keeps a full-text index of the pages under each
+   MANPATH directory in the file FTS_NAME there, for `man -K'.  The
+   text of a page is what remains after dropping roff requests other
+   than the font and heading macros, roff escapes, and overstrikes.  A
+   term is a run of letters, digits and underscores, folded to lower
+   case; its position is its number among all the terms of the page.
+
+   All numbers in the file are 32-bit little-endian, unless said to be
+   varints: 7 bits per byte, low bits first, the high bit set in all
+   bytes but the last.  The file holds, in this order:
+
+     FTS_MAGIC
+     the number of pages, of terms, and of terms in all pages
+     the offsets of the page table, the term table and the postings
+     the offsets of the pages' entries, then the entries:
+       the page's mtime, size and number of terms, then its name
+       relative to the top, null-terminated
+     the offsets of the terms' entries, then the entries, by term:
+       the term, null-terminated, the number of pages which have it,
+       and the offset and size of its postings
+     the postings of all the terms
+
+   The postings of a term are, for each page which has it, in
+   increasing order of pages: the page number minus the previous one
+   (the first page number plus one for the first page), the number of
+   times the page has the term, and for each time, the position minus
+   the previous one (the position plus one the first time); all of
+   them varints.
+
+   Updating the index reads only the pages whose mtime or size changed;
+   the postings of the others are carried over from the old index.  */
+
+#define FTS_MAGIC	"man fts 1\n"
+#define FTS_HEADER	(10 + 6 * 4)	/* the magic and six numbers */
+#define MAX_TERM	32		/* longer terms are cut to this */
+#define TERM_BUCKETS	16384
+
+/* A growing buffer of bytes.  */
+typedef struct {
+  unsigned char *data;
+  size_t len, alloc;
+} Byte_buf;
+
+void
+put_bytes (Byte_buf *b, const void *data, size_t len)
+{
+  if (b->len + len > b->alloc)
+    {
+      b->alloc = 2 * b->alloc + len + 64;
+      b->data = (unsigned char *)xrealloc (b->data, b->alloc);
+    }
+  memcpy (b->data + b->len, data, len);
+  b->len += len;
+}
+
+void
+set_u32 (unsigned char *p, unsigned long v)
+{
+  p[0] = v & 0xff;
+  p[1] = (v >> 8) & 0xff;
+  p[2] = (v >> 16) & 0xff;
+  p[3] = (v >> 24) & 0xff;
+}
+
+void
+put_u32 (Byte_buf *b, unsigned long v)
+{
+  unsigned char c[4];
+
+  set_u32 (c, v);
+  put_bytes (b, c, 4);
+}
+
+void
+put_varint (Byte_buf *b, unsigned long v)
+{
+  unsigned char c[10];
+  int n = 0;
+
+  while (v >= 0x80)
+    {
+      c[n++] = (v & 0x7f) | 0x80;
+      v >>= 7;
+    }
+  c[n++] = v;
+  put_bytes (b, c, n);
+}
+
+unsigned long
+get_u32 (const unsigned char *p)
+{
+  return ((unsigned long)p[0] | ((unsigned long)p[1] << 8)
+	  | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24));
+}
+
+/* Decode the varint at *P, which must end before END, and advance *P
+   past it.  Returns zero, and sets *P to END, if the varint is cut.  */
+unsigned long
+get_varint (const unsigned char **p, const unsigned char *end)
+{
+  unsigned long v = 0;
+  int shift = 0;
+
+  while (*p < end && shift < 32)
+    {
+      unsigned c = *(*p)++;
+
+      v |= (unsigned long)(c & 0x7f) << shift;
+      if (!(c & 0x80))
+	return v;
+      shift += 7;
+    }
+  *p = end;
+  return 0;
+}
+
+/* Read all of FILE into a malloc'ed buffer, and store its size in
+   *SIZE.  Returns null if FILE cannot be read.  */
+char *
+read_file (const char *file, size_t *size)
+{
+  FILE *fp = fopen (file, "rb");
+  char *buf = (char *)0;
+  size_t used = 0, alloc = 0, n;
+
+  if (!fp)
+    return (char *)0;
+  do
+    {
+      if (alloc - used < 4096)
+	buf = (char *)xrealloc (buf, alloc = 2 * alloc + 4096);
+      n = fread (buf + used, 1, alloc - used, fp);
+      used += n;
+    }
+  while (n > 0);
+  if (ferror (fp))
+    {
+      free (buf);
+      buf = (char *)0;
+    }
+  fclose (fp);
+  *size = used;
+  return buf;
+}
+
+/* A file mapped into memory, or on DOS, read into it.  */
+typedef struct {
+  const unsigned char *data;
+  size_t size;
+#ifdef __WIN32__
+  HANDLE file, mapping;
+#endif
+} Mapped_file;
+
+/* Map FILE into MF.  Returns zero on success.  */
+int
+map_file (const char *file, Mapped_file *mf)
+{
+#if defined (__WIN32__)
+  DWORD high;
+
+  mf->file = CreateFile (file, GENERIC_READ, FILE_SHARE_READ, NULL,
+			 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (mf->file == INVALID_HANDLE_VALUE)
+    return -1;
+  mf->size = GetFileSize (mf->file, &high);
+  mf->mapping = (mf->size == 0 || high != 0 ? NULL
+		 : CreateFileMapping (mf->file, NULL, PAGE_READONLY, 0, 0, NULL));
+  if (mf->mapping == NULL
+      || (mf->data = MapViewOfFile (mf->mapping, FILE_MAP_READ, 0, 0, 0)) == 0)
+    {
+      if (mf->mapping != NULL)
+	CloseHandle (mf->mapping);
+      CloseHandle (mf->file);
+      return -1;
+    }
+  return 0;
+#elif !defined (MSDOS)
+  struct stat st;
+  int fd = open (file, O_RDONLY);
+  void *p;
+
+  if (fd < 0)
+    return -1;
+  if (fstat (fd, &st) || st.st_size == 0
+      || (p = mmap (0, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED)
+    {
+      close (fd);
+      return -1;
+    }
+  close (fd);
+  mf->data = (const unsigned char *)p;
+  mf->size = st.st_size;
+  return 0;
+#else
+  mf->data = (const unsigned char *)read_file (file, &mf->size);
+  return mf->data ? 0 : -1;
+#endif
+}
+
+void
+unmap_file (Mapped_file *mf)
+{
+#if defined (__WIN32__)
+  UnmapViewOfFile ((LPCVOID)mf->data);
+  CloseHandle (mf->mapping);
+  CloseHandle (mf->file);
+#elif !defined (MSDOS)
+  munmap ((void *)mf->data, mf->size);
+#else
+  free ((void *)mf->data);
+#endif
+}
+
+/* An index as it is on disk, mapped into memory.  */
+typedef struct {
+  Mapped_file file;
+  unsigned long ndocs, nterms, total_len;
+  const unsigned char *docs;	/* offsets of the page entries */
+  const unsigned char *terms;	/* offsets of the term entries */
+  const unsigned char *postings;
+} Fts_image;
+
+/* Map the full-text index FILE into IMG.  Returns zero on success.  */
+int
+open_fts (const char *file, Fts_image *img)
+{
+  const unsigned char *d;
+  size_t size;
+  unsigned long docs_off, terms_off, post_off;
+
+  if (map_file (file, &img->file))
+    return -1;
+  d = img->file.data;
+  size = img->file.size;
+  if (size < FTS_HEADER || memcmp (d, FTS_MAGIC, 10) != 0)
+    goto bad;
+  img->ndocs = get_u32 (d + 10);
+  img->nterms = get_u32 (d + 14);
+  img->total_len = get_u32 (d + 18);
+  docs_off = get_u32 (d + 22);
+  terms_off = get_u32 (d + 26);
+  post_off = get_u32 (d + 30);
+  if (docs_off + 4 * img->ndocs > size || terms_off + 4 * img->nterms > size
+      || post_off > size || img->ndocs > size || img->nterms > size)
+    goto bad;
+  img->docs = d + docs_off;
+  img->terms = d + terms_off;
+  img->postings = d + post_off;
+  return 0;
+
+ bad:
+  if (verbose_option)
+    fprintf (stderr, "%s: %s is unusable, ignoring it\n", progname, file);
+  unmap_file (&img->file);
+  return -1;
+}
+
+/* Return the entry of page N in IMG, or null if it is damaged.  */
+const unsigned char *
+fts_doc (const Fts_image *img, unsigned long n)
+{
+  unsigned long off = get_u32 (img->docs + 4 * n);
+
+  if (off + 13 > img->file.size
+      || !memchr (img->file.data + off + 12, '\0', img->file.size - off - 12))
+    return (unsigned char *)0;
+  return img->file.data + off;
+}
+
+/* Find TERM in IMG.  Returns its entry past the term, or null.  */
+const unsigned char *
+fts_term (const Fts_image *img, const char *term)
+{
+  unsigned long lo = 0, hi = img->nterms;
+
+  while (lo < hi)
+    {
+      unsigned long mid = lo + (hi - lo) / 2;
+      unsigned long off = get_u32 (img->terms + 4 * mid);
+      const char *t = (const char *)img->file.data + off;
+      size_t len;
+      int cmp;
+
+      if (off >= img->file.size
+	  || !memchr (t, '\0', img->file.size - off))
+	return (unsigned char *)0;
+      len = strlen (t);
+      if (off + len + 13 > img->file.size)
+	return (unsigned char *)0;
+      if ((cmp = strcmp (term, t)) == 0)
+	return (const unsigned char *)t + len + 1;
+      if (cmp < 0)
+	hi = mid;
+      else
+	lo = mid + 1;
+    }
+  return (unsigned char *)0;
+}
+
+/* Extracting the terms.  */
+
+/* Drop roff requests, escapes and overstrikes from the page TEXT of LEN
+   bytes, leaving the words.  FORMATTED is non-zero for pre-formatted
+   pages, which have no roff in them.  Works in place, and returns the
+   new length.  */
+size_t
+page_words (char *text, size_t len, int formatted)
+{
+  char *in = text, *out = text, *end = text + len;
+  int bol = 1;
+
+  while (in < end)
+    {
+      int c = (unsigned char)*in++;
+
+      if (c == '\b')
+	{
+	  /* "_\bc" and "c\bc": keep only the c.  */
+	  if (out > text)
+	    out--;
+	  continue;
+	}
+      if (formatted)
+	{
+	  *out++ = c;
+	  continue;
+	}
+      if (bol && (c == '.' || c == '\''))
+	{
+	  /* A request.  The font and heading macros have text in their
+	     arguments; skip the others to the end of the line.  */
+	  const char *name = in;
+	  size_t n;
+
+	  while (name < end && (*name == ' ' || *name == '\t'))
+	    name++;
+	  for (n = 0; name + n < end && isalpha ((unsigned char)name[n]); n++)
+	    ;
+	  if (!((n == 1 && strchr ("BI", name[0]))
+		|| (n == 2 && (strncmp (name, "BR", 2) == 0
+			       || strncmp (name, "BI", 2) == 0
+			       || strncmp (name, "IB", 2) == 0
+			       || strncmp (name, "IR", 2) == 0
+			       || strncmp (name, "RB", 2) == 0
+			       || strncmp (name, "RI", 2) == 0
+			       || strncmp (name, "SH", 2) == 0
+			       || strncmp (name, "SS", 2) == 0
+			       || strncmp (name, "SM", 2) == 0
+			       || strncmp (name, "SB", 2) == 0
+			       || strncmp (name, "IP", 2) == 0))))
+	    {
+	      while (in < end && *in != '\n')
+		in++;
+	      continue;
+	    }
+	  in = (char *)name + n;
+	  *out++ = ' ';
+	  bol = 0;
+	  continue;
+	}
+      bol = (c == '\n');
+      if (c != '\\' || in >= end)
+	{
+	  *out++ = c;
+	  continue;
+	}
+
+      /* An escape.  */
+      c = (unsigned char)*in++;
+      switch (c)
+	{
+	  case '"':	/* a comment */
+	    while (in < end && *in != '\n')
+	      in++;
+	    break;
+	  case 'f':	/* \fB \f(CW \f[CW] */
+	  case '*':	/* \*x \*(xx \*[name] */
+	  case 's':	/* \s+1 \s0 */
+	  case '(':	/* \(em */
+	    if (c == 's' && in < end && (*in == '+' || *in == '-'))
+	      in++;
+	    if (c == '(')
+	      in += 2;
+	    else if (in < end && *in == '(')
+	      in += 3;
+	    else if (in < end && *in == '[')
+	      {
+		while (in < end && *in != ']')
+		  in++;
+		in++;
+	      }
+	    else
+	      in++;
+	    if (c == 's')
+	      while (in < end && isdigit ((unsigned char)*in))
+		in++;
+	    *out++ = ' ';
+	    break;
+	  case '&':	/* zero-width */
+	  case '|':
+	  case '^':
+	  case '\n':	/* a continued line */
+	    break;
+	  default:
+	    *out++ = ' ';
+	    break;
+	}
+    }
+  return out - text;
+}
+
+/* Call EMIT for each term in the LEN bytes of TEXT, with the term, its
+   length, its position and ARG.  Returns the number of terms.  */
+unsigned long
+each_term (const char *text, size_t len,
+	   void (*emit) (const char *, size_t, unsigned long, void *),
+	   void *arg)
+{
+  const char *end = text + len;
+  unsigned long pos = 0;
+  char term[MAX_TERM];
+
+  while (text < end)
+    {
+      size_t n = 0;
+
+      while (text < end && !isalnum ((unsigned char)*text) && *text != '_')
+	text++;
+      while (text < end && (isalnum ((unsigned char)*text) || *text == '_'))
+	{
+	  if (n < MAX_TERM)
+	    term[n++] = tolower ((unsigned char)*text);
+	  text++;
+	}
+      if (n)
+	emit (term, n, pos++, arg);
+    }
+  return pos;
+}
+
+/* Building an index.  */
+
+/* A page in the index being built.  */
+typedef struct {
+  char *name;		/* relative to the top */
+  unsigned long mtime, size;
+  unsigned long length;	/* how many terms it has */
+  long old;		/* its number in the old index, or -1 */
+} Fts_doc;
+
+/* A term in the index being built.  */
+typedef struct fts_term {
+  char *term;
+  unsigned long df;	/* how many pages have it */
+  unsigned long prev;	/* the last page with it, plus one */
+  Byte_buf postings;
+  unsigned long *pos;	/* its positions in the page being read */
+  size_t npos, max_pos;
+  struct fts_term *next;	/* in its bucket */
+  struct fts_term *next_touched;
+} Fts_term;
+
+typedef struct {
+  Fts_term *buckets[TERM_BUCKETS];
+  unsigned long nterms;
+  Fts_term *touched;	/* the terms of the page being read */
+} Fts_build;
+
+Fts_term *
+intern_term (Fts_build *fb, const char *term, size_t len)
+{
+  unsigned hash = 0;
+  size_t i;
+  Fts_term *t;
+
+  for (i = 0; i < len; i++)
+    hash = hash * 31 + (unsigned char)term[i];
+  hash %= TERM_BUCKETS;
+  for (t = fb->buckets[hash]; t; t = t->next)
+    if (strncmp (t->term, term, len) == 0 && t->term[len] == '\0')
+      return t;
+  t = (Fts_term *)xmalloc (sizeof (Fts_term));
+  memset (t, 0, sizeof (Fts_term));
+  t->term = (char *)xmalloc (len + 1);
+  memcpy (t->term, term, len);
+  t->term[len] = '\0';
+  t->next = fb->buckets[hash];
+  fb->buckets[hash] = t;
+  fb->nterms++;
+  return t;
+}
+
+/* Record the term at POS in the page being read.  */
+void
+note_term (const char *term, size_t len, unsigned long pos, void *arg)
+{
+  Fts_build *fb = (Fts_build *)arg;
+  Fts_term *t = intern_term (fb, term, len);
+
+  if (t->npos == 0)
+    {
+      t->next_touched = fb->touched;
+      fb->touched = t;
+    }
+  if (t->npos >= t->max_pos)
+    {
+      t->max_pos = 2 * t->max_pos + 8;
+      t->pos = (unsigned long *)xrealloc (t->pos,
+					  t->max_pos * sizeof (unsigned long));
+    }
+  t->pos[t->npos++] = pos;
+}
+
+/* Start the postings of page DOC in term T, which it has TF times.  */
+void
+add_posting (Fts_term *t, unsigned long doc, unsigned long tf)
+{
+  put_varint (&t->postings, doc + 1 - t->prev);
+  put_varint (&t->postings, tf);
+  t->prev = doc + 1;
+  t->df++;
+}
+
+/* Read page DOC, whose file is PATH, into the index being built.  */
+void
+index_page (Fts_build *fb, Fts_doc *doc, unsigned long n, const char *path)
+{
+  size_t size;
+  char *text = read_file (path, &size);
+  Fts_term *t;
+  int formatted;
+
+  doc->length = 0;
+  if (!text)
+    {
+      if (verbose_option)
+	fprintf (stderr, "%s: `%s' is unreadable: %s\n", progname, path,
+		 strerror (errno));
+      return;
+    }
+  formatted = size > 0 && text[0] != '.' && text[0] != '\'';
+  size = page_words (text, size, formatted);
+  doc->length = each_term (text, size, note_term, fb);
+  free (text);
+
+  for (t = fb->touched; t; t = t->next_touched)
+    {
+      unsigned long prev = 0;
+      size_t i;
+
+      add_posting (t, n, t->npos);
+      for (i = 0; i < t->npos; i++)
+	{
+	  put_varint (&t->postings, t->pos[i] + 1 - prev);
+	  prev = t->pos[i] + 1;
+	}
+      t->npos = 0;
+    }
+  fb->touched = (Fts_term *)0;
+}
+
+/* Carry the postings of the pages kept from the old index IMG over to
+   the index being built.  MAP gives the new number of each old page, or
+   -1 for pages which are gone or changed.  */
+void
+carry_over (Fts_build *fb, const Fts_image *img, const long *map)
+{
+  unsigned long i;
+
+  for (i = 0; i < img->nterms; i++)
+    {
+      unsigned long off = get_u32 (img->terms + 4 * i);
+      const char *term = (const char *)img->file.data + off;
+      const unsigned char *e, *p, *end;
+      unsigned long df, doc = 0, j;
+      Fts_term *t = (Fts_term *)0;
+
+      if (off >= img->file.size || !memchr (term, '\0', img->file.size - off))
+	continue;
+      e = (const unsigned char *)term + strlen (term) + 1;
+      if (e + 12 > img->file.data + img->file.size)
+	continue;
+      df = get_u32 (e);
+      p = img->postings + get_u32 (e + 4);
+      end = p + get_u32 (e + 8);
+      if (end > img->file.data + img->file.size || p > end)
+	continue;
+      for (j = 0; j < df && p < end; j++)
+	{
+	  unsigned long tf, k;
+	  const unsigned char *positions;
+
+	  doc += get_varint (&p, end) - 1;
+	  tf = get_varint (&p, end);
+	  positions = p;
+	  for (k = 0; k < tf; k++)
+	    get_varint (&p, end);
+	  /* A damaged index could have the pages out of order.  */
+	  if (doc >= img->ndocs || map[doc] < 0
+	      || (t && (unsigned long)map[doc] < t->prev))
+	    {
+	      doc++;
+	      continue;
+	    }
+	  if (!t)
+	    t = intern_term (fb, term, strlen (term));
+	  add_posting (t, map[doc], tf);
+	  put_bytes (&t->postings, positions, p - positions);
+	  doc++;
+	}
+    }
+}
+
+int
+compare_doc_names (const void *p1, const void *p2)
+{
+  return strcmp (((const Fts_doc *)p1)->name, ((const Fts_doc *)p2)->name);
+}
+
+int
+compare_doc_numbers (const void *p1, const void *p2)
+{
+  long n1 = ((const Fts_doc *)p1)->old, n2 = ((const Fts_doc *)p2)->old;
+
+  return n1 < n2 ? -1 : n1 > n2;
+}
+
+int
+compare_terms (const void *p1, const void *p2)
+{
+  return strcmp ((*(Fts_term * const *)p1)->term,
+		 (*(Fts_term * const *)p2)->term);
+}
+
+/* Non-zero if file NAME in a manual directory should not be indexed:
+   it is compressed, or one of our own index files.  */
+int
+not_a_page (const char *name)
+{
+  const char *dot = strrchr (name, '.');
+
+  return ((dot && (strcmp (dot, ".gz") == 0 || strcmp (dot, ".Z") == 0
+		   || strcmp (dot, ".z") == 0 || strcmp (dot, ".bz2") == 0))
+	  || is_index_file (name));
+}
+
+/* Add the regular files among the NAMES in subdirectory SUBDIR of TOP
+   ("." for TOP itself) to the NDOCS pages in DOCS, which has room for
+   MAXDOCS.  */
+void
+add_docs (const char *top, const char *subdir, char **names, int count,
+	  Fts_doc **docs, unsigned long *ndocs, unsigned long *maxdocs)
+{
+  char path[FILENAME_MAX];
+  struct stat st;
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      Fts_doc *d;
+
+      if (not_a_page (names[i]))
+	continue;
+      if (strcmp (subdir, ".") == 0)
+	sprintf (path, "%s/%s", top, names[i]);
+      else
+	sprintf (path, "%s/%s/%s", top, subdir, names[i]);
+      if (stat (path, &st) || !S_ISREG (st.st_mode))
+	continue;
+      if (*ndocs >= *maxdocs)
+	{
+	  *maxdocs = *maxdocs ? 2 * *maxdocs : 64;
+	  *docs = (Fts_doc *)xrealloc (*docs, *maxdocs * sizeof (Fts_doc));
+	}
+      d = &(*docs)[(*ndocs)++];
+      d->name = (char *)xmalloc (strlen (path) - strlen (top));
+      strcpy (d->name, path + strlen (top) + 1);
+      d->mtime = (unsigned long)st.st_mtime;
+      d->size = (unsigned long)st.st_size;
+      d->old = -1;
+    }
+}
+
+/* Bring the full-text index of TOP up to date.  TOP_DIR lists TOP,
+   and the NDIRS listings in DIRS its manN and catN subdirectories.  */
+int
+update_fts (const char *top, const Dir_listing *top_dir,
+	    const Dir_listing *dirs, int ndirs)
+{
+  char file[FILENAME_MAX], temp[FILENAME_MAX], path[FILENAME_MAX];
+  Fts_doc *docs = (Fts_doc *)0, *order;
+  unsigned long ndocs = 0, maxdocs = 0, nkept = 0, total = 0, i, n, off;
+  Fts_image old;
+  int have_old, status = 0;
+  long *map = (long *)0;
+  Fts_build *fb = (Fts_build *)xmalloc (sizeof (Fts_build));
+  Fts_term **terms, *t;
+  Byte_buf out;
+  FILE *fp;
+  int d;
+
+  memset (fb, 0, sizeof (Fts_build));
+  add_docs (top, ".", top_dir->names, top_dir->count, &docs, &ndocs,
+	    &maxdocs);
+  for (d = 0; d < ndirs; d++)
+    add_docs (top, dirs[d].name, dirs[d].names, dirs[d].count,
+	      &docs, &ndocs, &maxdocs);
+
+  /* Find which pages did not change since the old index was written.  */
+  sprintf (file, "%s/%s", top, FTS_NAME);
+  sprintf (temp, "%s/%s", top, FTS_TEMP);
+  have_old = open_fts (file, &old) == 0;
+  if (have_old)
+    {
+      qsort (docs, ndocs, sizeof (Fts_doc), compare_doc_names);
+      map = (long *)xmalloc ((old.ndocs + 1) * sizeof (long));
+      for (i = 0; i < old.ndocs; i++)
+	{
+	  const unsigned char *e = fts_doc (&old, i);
+	  Fts_doc key, *found;
+
+	  map[i] = -1;
+	  if (!e)
+	    continue;
+	  key.name = (char *)e + 12;
+	  found = (Fts_doc *)bsearch (&key, docs, ndocs, sizeof (Fts_doc),
+				      compare_doc_names);
+	  if (found && found->mtime == get_u32 (e)
+	      && found->size == get_u32 (e + 4))
+	    {
+	      found->old = i;
+	      found->length = get_u32 (e + 8);
+	    }
+	}
+    }
+
+  /* Number the kept pages first, in their old order, so that their
+     postings stay in increasing order of pages; then the pages to be
+     read.  */
+  order = (Fts_doc *)xmalloc ((ndocs + 1) * sizeof (Fts_doc));
+  for (i = 0; i < ndocs; i++)
+    if (docs[i].old >= 0)
+      order[nkept++] = docs[i];
+  qsort (order, nkept, sizeof (Fts_doc), compare_doc_numbers);
+  for (i = 0; i < nkept; i++)
+    map[order[i].old] = i;
+  for (i = 0, n = nkept; i < ndocs; i++)
+    if (docs[i].old < 0)
+      order[n++] = docs[i];
+  free (docs);
+  docs = order;
+
+  if (have_old)
+    {
+      carry_over (fb, &old, map);
+      unmap_file (&old.file);
+      free (map);
+    }
+  for (i = nkept; i < ndocs; i++)
+    {
+      sprintf (path, "%s/%s", top, docs[i].name);
+      if (debugging_output)
+	fprintf (stderr, "Indexing `%s'\n", path);
+      index_page (fb, &docs[i], i, path);
+    }
+
+  /* Lay the index out.  */
+  terms = (Fts_term **)xmalloc ((fb->nterms + 1) * sizeof (Fts_term *));
+  for (i = 0, n = 0; i < TERM_BUCKETS; i++)
+    for (t = fb->buckets[i]; t; t = t->next)
+      terms[n++] = t;
+  qsort (terms, n, sizeof (Fts_term *), compare_terms);
+  for (i = 0; i < ndocs; i++)
+    total += docs[i].length;
+
+  memset (&out, 0, sizeof out);
+  put_bytes (&out, FTS_MAGIC, 10);
+  put_u32 (&out, ndocs);
+  put_u32 (&out, n);
+  put_u32 (&out, total);
+  put_u32 (&out, 0);	/* the offsets, filled in below */
+  put_u32 (&out, 0);
+  put_u32 (&out, 0);
+
+  /* The page table, then the pages.  */
+  set_u32 (out.data + 22, out.len);
+  off = out.len + 4 * ndocs;
+  for (i = 0; i < ndocs; i++)
+    {
+      put_u32 (&out, off);
+      off += 12 + strlen (docs[i].name) + 1;
+    }
+  for (i = 0; i < ndocs; i++)
+    {
+      put_u32 (&out, docs[i].mtime);
+      put_u32 (&out, docs[i].size);
+      put_u32 (&out, docs[i].length);
+      put_bytes (&out, docs[i].name, strlen (docs[i].name) + 1);
+    }
+
+  /* The term table, then the terms; the postings follow them.  */
+  set_u32 (out.data + 26, out.len);
+  off = out.len + 4 * n;
+  for (i = 0; i < n; i++)
+    {
+      put_u32 (&out, off);
+      off += strlen (terms[i]->term) + 1 + 12;
+    }
+  for (i = 0, off = 0; i < n; i++)
+    {
+      put_bytes (&out, terms[i]->term, strlen (terms[i]->term) + 1);
+      put_u32 (&out, terms[i]->df);
+      put_u32 (&out, off);
+      put_u32 (&out, terms[i]->postings.len);
+      off += terms[i]->postings.len;
+    }
+  set_u32 (out.data + 30, out.len);
+
+  if ((fp = fopen (temp, "wb")) == 0)
+    status = 1;
+  else
+    {
+      fwrite (out.data, 1, out.len, fp);
+      for (i = 0; i < n; i++)
+	fwrite (terms[i]->postings.data, 1, terms[i]->postings.len, fp);
+      if (ferror (fp) | fclose (fp) || replace_file (temp, file))
+	{
+	  remove (temp);
+	  status = 1;
+	}
+    }
+  if (status)
+    fprintf (stderr, "%s: cannot write %s: %s\n", progname, file,
+	     strerror (errno));
+  else if (verbose_option)
+    fprintf (stderr, "%s: %s: %lu pages, %lu of them read, %lu terms\n",
+	     progname, file, ndocs, ndocs - nkept, n);
+
+  for (i = 0; i < n; i++)
+    {
+      free (terms[i]->term);
+      free (terms[i]->postings.data);
+      free (terms[i]->pos);
+      free (terms[i]);
+    }
+  free (terms);
+  free (fb);
+  free (out.data);
+  for (i = 0; i < ndocs; i++)
+    free (docs[i].name);
+  free (docs);
+  return status;
+}
+
+/* Searching the index.  */
+
+/* BM25 parameters.  */
+#define BM25_K1		1.2
+#define BM25_B		0.75
+
+/* A page which matched, and how well.  */
+typedef struct {
+  char *path;
+  double score;
+} Fts_hit;
+
+static Fts_hit *hits;
+static int nhits, max_hits;
+
+/* The terms of the query.  */
+typedef struct {
+  char term[MAX_TERM + 1];
+  unsigned long df;
+  unsigned long *docs, *tf, *first;	/* FIRST indexes POS */
+  unsigned long *pos;
+  unsigned long cursor;
+} Query_term;
+
+typedef struct {
+  Query_term *terms;
+  int nterms;
+} Query;
+
+void
+note_query_term (const char *term, size_t len, unsigned long pos, void *arg)
+{
+  Query *q = (Query *)arg;
+  Query_term *qt;
+
+  (void)pos;
+  q->terms = (Query_term *)xrealloc (q->terms,
+				     (q->nterms + 1) * sizeof (Query_term));
+  qt = &q->terms[q->nterms++];
+  memset (qt, 0, sizeof (Query_term));
+  memcpy (qt->term, term, len);
+  qt->term[len] = '\0';
+}
+
+/* Decode the postings of QT from IMG.  Returns zero if the index does
+   not have the term.  */
+int
+decode_postings (const Fts_image *img, Query_term *qt)
+{
+  const unsigned char *e = fts_term (img, qt->term), *p, *end;
+  unsigned long doc = 0, i, npos = 0, max_pos = 0;
+
+  if (!e)
+    return 0;
+  qt->df = get_u32 (e);
+  p = img->postings + get_u32 (e + 4);
+  end = p + get_u32 (e + 8);
+  if (end > img->file.data + img->file.size || p > end
+      || qt->df > (unsigned long)(end - p))
+    return 0;
+  qt->docs = (unsigned long *)xmalloc ((qt->df + 1) * sizeof (unsigned long));
+  qt->tf = (unsigned long *)xmalloc ((qt->df + 1) * sizeof (unsigned long));
+  qt->first = (unsigned long *)xmalloc ((qt->df + 1) * sizeof (unsigned long));
+  for (i = 0; i < qt->df; i++)
+    {
+      unsigned long k, prev = 0;
+
+      doc += get_varint (&p, end) - 1;
+      qt->docs[i] = doc++;
+      qt->tf[i] = get_varint (&p, end);
+      qt->first[i] = npos;
+      for (k = 0; k < qt->tf[i] && p < end; k++)
+	{
+	  if (npos >= max_pos)
+	    {
+	      max_pos = 2 * max_pos + 64;
+	      qt->pos = (unsigned long *)xrealloc (qt->pos, max_pos
+						   * sizeof (unsigned long));
+	    }
+	  prev += get_varint (&p, end) - 1;
+	  qt->pos[npos++] = prev++;
+	}
+      qt->tf[i] = k;
+    }
+  return 1;
+}
+
+/* Non-zero if QT has position POS in its I'th page.  */
+int
+has_position (const Query_term *qt, unsigned long i, unsigned long pos)
+{
+  const unsigned long *lo = qt->pos + qt->first[i], *hi = lo + qt->tf[i];
+
+  while (lo < hi)
+    {
+      const unsigned long *mid = lo + (hi - lo) / 2;
+
+      if (*mid == pos)
+	return 1;
+      if (*mid < pos)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return 0;
+}
+
+/* Find the pages in the index of TOP which have the terms of Q one
+   after another, and add them to HITS.  */
+void
+search_fts (const char *top, Query *q)
+{
+  char file[FILENAME_MAX];
+  Fts_image img;
+  Query_term *rarest, *first = &q->terms[0];
+  double avgdl;
+  unsigned long i;
+  int j;
+
+  sprintf (file, "%s/%s", top, FTS_NAME);
+  if (open_fts (file, &img))
+    {
+      if (verbose_option)
+	fprintf (stderr, "%s: %s has no full-text index; try `man -u'\n",
+		 progname, top);
+      return;
+    }
+  for (j = 0; j < q->nterms; j++)
+    if (!decode_postings (&img, &q->terms[j]))
+      goto done;
+  avgdl = img.ndocs ? (double)img.total_len / img.ndocs : 1.0;
+
+  /* Walk the pages of the rarest term, and look for each in the
+     others; all the lists are in increasing order of pages.  */
+  rarest = &q->terms[0];
+  for (j = 0; j < q->nterms; j++)
+    {
+      q->terms[j].cursor = 0;
+      if (q->terms[j].df < rarest->df)
+	rarest = &q->terms[j];
+    }
+  for (i = 0; i < rarest->df; i++)
+    {
+      unsigned long doc = rarest->docs[i], k;
+      const unsigned char *e;
+      double score = 0.0, dl;
+      int phrase = 0;
+
+      for (j = 0; j < q->nterms; j++)
+	{
+	  Query_term *qt = &q->terms[j];
+
+	  while (qt->cursor < qt->df && qt->docs[qt->cursor] < doc)
+	    qt->cursor++;
+	  if (qt->cursor >= qt->df || qt->docs[qt->cursor] != doc)
+	    break;
+	}
+      if (j < q->nterms || (e = fts_doc (&img, doc)) == 0)
+	continue;
+
+      /* The terms must follow each other.  */
+      for (k = 0; k < first->tf[first->cursor] && !phrase; k++)
+	{
+	  unsigned long pos = first->pos[first->first[first->cursor] + k];
+
+	  for (j = 1; j < q->nterms; j++)
+	    if (!has_position (&q->terms[j], q->terms[j].cursor, pos + j))
+	      break;
+	  phrase = j == q->nterms;
+	}
+      if (!phrase)
+	continue;
+
+      dl = (double)get_u32 (e + 8);
+      for (j = 0; j < q->nterms; j++)
+	{
+	  Query_term *qt = &q->terms[j];
+	  double tf = qt->tf[qt->cursor];
+	  double idf = log (1.0 + (img.ndocs - qt->df + 0.5) / (qt->df + 0.5));
+
+	  score += idf * tf * (BM25_K1 + 1)
+		   / (tf + BM25_K1 * (1 - BM25_B + BM25_B * dl / avgdl));
+	}
+
+      if (nhits >= max_hits)
+	{
+	  max_hits = 2 * max_hits + 16;
+	  hits = (Fts_hit *)xrealloc (hits, max_hits * sizeof (Fts_hit));
+	}
+      hits[nhits].path = (char *)xmalloc (strlen (top) + strlen ((char *)e + 12) + 2);
+      sprintf (hits[nhits].path, "%s/%s", top, (char *)e + 12);
+      hits[nhits++].score = score;
+    }
+
+ done:
+  for (j = 0; j < q->nterms; j++)
+    {
+      Query_term *qt = &q->terms[j];
+
+      free (qt->docs);
+      free (qt->tf);
+      free (qt->first);
+      free (qt->pos);
+      qt->docs = qt->tf = qt->first = qt->pos = (unsigned long *)0;
+      qt->df = 0;
+    }
+  unmap_file (&img.file);
+}
+
+int
+compare_hits (const void *p1, const void *p2)
+{
+  const Fts_hit *h1 = (const Fts_hit *)p1, *h2 = (const Fts_hit *)p2;
+
+  if (h1->score != h2->score)
+    return h1->score < h2->score ? 1 : -1;
+  return strcmp (h1->path, h2->path);
+}
+
+/* List the pages whose text has PHRASE, best matches first.  */
+int
+search_pages (const char *phrase)
+{
+  const char *list = search_roots ();
+  char top[FILENAME_MAX], locale_dir[FILENAME_MAX];
+  Query q;
+  int i;
+
+  q.terms = (Query_term *)0;
+  q.nterms = 0;
+  each_term (phrase, strlen (phrase), note_query_term, &q);
+  if (q.nterms == 0)
+    {
+      fprintf (stderr, "%s: nothing to search for in `%s'\n",
+	       progname, phrase);
+      return 1;
+    }
+
+  while (next_path_dir (&list, top))
+    {
+      unsigned present = locale_subtrees (top);
+
+      for (i = 0; i < nlocales; i++)
+	if ((present & (1 << i))
+	    && strlen (top) + strlen (locale_names[i]) + 2 <= sizeof locale_dir)
+	  {
+	    strcat (strcat (strcpy (locale_dir, top), "/"), locale_names[i]);
+	    search_fts (locale_dir, &q);
+	  }
+      search_fts (top, &q);
+    }
+  free (q.terms);
+
+  if (nhits == 0)
+    {
+      printf ("No manual entry mentions %s.\n", phrase);
+      return 2;
+    }
+  qsort (hits, nhits, sizeof (Fts_hit), compare_hits);
+  for (i = 0; i < nhits; i++)
+    {
+      if (verbose_option)
+	printf ("%8.3f  ", hits[i].score);
+      printf ("%s\n", hits[i].path);
+      free (hits[i].path);
+    }
+  nhits = 0;
+  return 0;
+}
+
+/* Bring the index of the MANPATH directory TOP up to date, and if
+   LOCALES is non-zero, those of its locale subtrees.  */
+int
+update_index (const char *top, int locales)
+{
+  Man_index *old;
+  Dir_listing top_dir, *dirs = (Dir_listing *)0, *l;
+  int ndirs = 0, reread = 0, i;
+  char file[FILENAME_MAX], temp[FILENAME_MAX];
+  FILE *fp;
+  int status = 0;
+
+  top_dir.name = ".";
+  if (read_listing (&top_dir, top))
+    return 1;
+  old = read_index (top);
+
+  /* Index all the manN and catN subdirectories, so that the index
+     serves lookups in any section.  */
+  for (i = 0; i < top_dir.count; i++)
+    {
+      const char *name = top_dir.names[i];
+      char path[FILENAME_MAX];
+      int r;
+
+      sprintf (path, "%s/%s", top, name);
+      if (fnmatch ("man?", name, 0) != 0
+	  && fnmatch ("cat?", name, MATCHFLAGS) != 0)
+	{
+	  if (locales && is_locale_name (name) && isadir (path))
+	    status |= update_index (path, 0);
+	  continue;
+	}
+      if (!isadir (path))
+	continue;
+      dirs = (Dir_listing *)xrealloc (dirs, (ndirs + 1) * sizeof (Dir_listing));
+      r = refresh_listing (old, top, name, &dirs[ndirs]);
+      if (r >= 0)
+	{
+	  reread += r;
+	  ndirs++;
+	}
+    }
+
+  sprintf (file, "%s/%s", top, INDEX_NAME);
+  sprintf (temp, "%s/%s", top, INDEX_TEMP);
+  if ((fp = fopen (temp, "wb")) == 0)
+    {
+      fprintf (stderr, "%s: cannot write %s: %s\n",
+	       progname, temp, strerror (errno));
+      status = 1;
+    }
+  else
+    {
+      fputs (INDEX_MAGIC, fp);
+      for (l = dirs; l < dirs + ndirs; l++)
+	{
+	  fprintf (fp, "d %d %lu %lu %lu %s\n", l->count,
+		   l->mtime, l->dev, l->ino, l->name);
+	  for (i = 0; i < l->count; i++)
+	    fprintf (fp, "%s\n", l->names[i]);
+	}
+      if (ferror (fp) | fclose (fp) || replace_file (temp, file))
+	{
+	  fprintf (stderr, "%s: cannot write %s: %s\n",
+		   progname, file, strerror (errno));
+	  remove (temp);
+	  status = 1;
+	}
+      else if (verbose_option)
+	fprintf (stderr, "%s: %s: %d directories, %d of them read\n",
+		 progname, file, ndirs, reread);
+    }
+  status |= update_fts (top, &top_dir, dirs, ndirs);
+
+  /* The listings name themselves with strings from TOP_DIR.  */
+  for (i = 0; i < ndirs; i++)
+    {
+      if (dirs[i].names)
+	free (dirs[i].names);
+      if (dirs[i].storage)
+	free (dirs[i].storage);
+    }
+  if (dirs)
+    free (dirs);
+  free (top_dir.names);
+  free (top_dir.storage);
+  free_index (old);
+  return status;
+}
+
+/* Bring the indices of all the MANPATH directories up to date.  */
+int
+update_indexes (void)
+{
+  const char *list = search_roots ();
+  char top[FILENAME_MAX];
+  int status = 0;
+
+  while (next_path_dir (&list, top))
+    status |= update_index (top, 1);
+  return status;
+}
+
+
+/* Regular expression topic search.
+
+   --regex RE lists the pages whose topic, the file name without the
+   section suffix, has a match of the extended regular expression RE.
+   RE is compiled into an NFA once, and the NFA is turned into a DFA
+   lazily, one state and one transition at a time, as the topics need
+   them; so each topic is matched in one pass over its characters,
+   without backtracking.  The topics come from the same directory
+   reads and indices as any other lookup.
+
+   Supported are literals, `.', bracket expressions with ranges and
+   [:class:]es, `*', `+', `?', {M}, {M,} and {M,N}, `|', parentheses,
+   `^', `$' and backslash quoting.  */
+
+#define NFA_SET		0	/* one character from a set */
+#define NFA_EMPTY	1	/* nothing; goes on to OUT */
+#define NFA_SPLIT	2	/* goes on to both OUT and OUT1 */
+#define NFA_BOL		3	/* the beginning of the topic */
+#define NFA_EOL		4	/* the end of the topic */
+#define NFA_MATCH	5
+
+typedef struct {
+  int type;
+  int out, out1;
+  int set;		/* NFA_SET: index into `Regex.sets' */
+} Nfa_node;
+
+/* A DFA state: the set of NFA nodes it stands for, and the states
+   each character leads to, or -1 where that is not known yet.  */
+typedef struct {
+  int *nodes;
+  int nnodes;
+  int accept;		/* 1 if the topic may end here, 2 if it matched
+			   whatever follows */
+  unsigned hash;
+  int chain;		/* next state in its hash bucket, or -1 */
+  int next[256];
+} Dfa_state;
+
+/* The DFA is rebuilt from scratch whenever it grows this big.  */
+#define DFA_MAX_STATES	1024
+#define DFA_BUCKETS	1024
+
+typedef struct {
+  Nfa_node *nfa;
+  int nnfa, max_nfa;
+  unsigned char (*sets)[32];
+  int nsets, max_sets;
+  int start;		/* the NFA start node */
+  Dfa_state *dfa;
+  int ndfa;
+  int buckets[DFA_BUCKETS];
+  int *stack, *mark;	/* scratch space for closures */
+  int *list, *scratch;	/* node lists of states being made */
+  int generation;
+  const char *error;	/* what is wrong with the expression */
+} Regex;
+
+/* A piece of the NFA: its start node and an NFA_EMPTY end node whose
+   OUT is still to be filled in.  */
+typedef struct {
+  int start, end;
+} Nfa_frag;
+
+static Regex *topic_regex;	/* with --regex, the expression */
+static unsigned long regex_found; /* how many topics matched it */
+
+int
+nfa_node (Regex *re, int type, int out, int out1)
+{
+  if (re->nnfa >= re->max_nfa)
+    {
+      re->max_nfa = re->max_nfa ? 2 * re->max_nfa : 64;
+      re->nfa = (Nfa_node *)xrealloc (re->nfa, re->max_nfa * sizeof (Nfa_node));
+    }
+  re->nfa[re->nnfa].type = type;
+  re->nfa[re->nnfa].out = out;
+  re->nfa[re->nnfa].out1 = out1;
+  re->nfa[re->nnfa].set = -1;
+  return re->nnfa++;
+}
+
+/* A fragment which matches one character from a new, empty set.  */
+Nfa_frag
+set_frag (Regex *re)
+{
+  Nfa_frag f;
+
+  if (re->nsets >= re->max_sets)
+    {
+      re->max_sets = re->max_sets ? 2 * re->max_sets : 16;
+      re->sets = (unsigned char (*)[32])xrealloc (re->sets,
+						 re->max_sets * 32);
+    }
+  memset (re->sets[re->nsets], 0, 32);
+  f.end = nfa_node (re, NFA_EMPTY, -1, -1);
+  f.start = nfa_node (re, NFA_SET, f.end, -1);
+  re->nfa[f.start].set = re->nsets++;
+  return f;
+}
+
+/* Add character C to the set of fragment F, in both cases if
+   pages are looked up regardless of case.  */
+void
+add_to_set (Regex *re, Nfa_frag f, int c)
+{
+  unsigned char *set = re->sets[re->nfa[f.start].set];
+
+  set[c >> 3] |= 1 << (c & 7);
+  if (MATCHFLAGS != 0)		/* that is, FNM_CASEFOLD */
+    {
+      set[tolower (c) >> 3] |= 1 << (tolower (c) & 7);
+      set[toupper (c) >> 3] |= 1 << (toupper (c) & 7);
+    }
+}
+
+/* A fragment made of a single node of TYPE.  */
+Nfa_frag
+node_frag (Regex *re, int type)
+{
+  Nfa_frag f;
+
+  f.end = nfa_node (re, NFA_EMPTY, -1, -1);
+  f.start = nfa_node (re, type, f.end, -1);
+  return f;
+}
+
+/* A fragment which matches A followed by B.  */
+Nfa_frag
+concat_frag (Regex *re, Nfa_frag a, Nfa_frag b)
+{
+  re->nfa[a.end].out = b.start;
+  a.end = b.end;
+  return a;
+}
+
+/* A fragment which matches A any number of times, at least once if
+   AT_LEAST_ONCE is set.  */
+Nfa_frag
+star_frag (Regex *re, Nfa_frag a, int at_least_once)
+{
+  Nfa_frag f;
+
+  f.end = nfa_node (re, NFA_EMPTY, -1, -1);
+  f.start = nfa_node (re, NFA_SPLIT, a.start, f.end);
+  re->nfa[a.end].out = f.start;
+  if (at_least_once)
+    f.start = a.start;
+  return f;
+}
+
+/* A fragment which matches either A or B.  A missing B matches the
+   empty string.  */
+Nfa_frag
+alt_frag (Regex *re, Nfa_frag a, Nfa_frag *b)
+{
+  Nfa_frag f;
+
+  f.end = nfa_node (re, NFA_EMPTY, -1, -1);
+  f.start = nfa_node (re, NFA_SPLIT, a.start, b ? b->start : f.end);
+  re->nfa[a.end].out = f.end;
+  if (b)
+    re->nfa[b->end].out = f.end;
+  return f;
+}
+
+Nfa_frag parse_alternatives (Regex *re, const char **p);
+
+/* Parse the bracket expression after the `[' at *P.  */
+Nfa_frag
+parse_bracket (Regex *re, const char **p)
+{
+  static const struct {
+    const char *name;
+    int (*is) (int);
+  } classes[] = {
+    { "alnum", isalnum }, { "alpha", isalpha }, { "cntrl", iscntrl },
+    { "digit", isdigit }, { "graph", isgraph }, { "lower", islower },
+    { "print", isprint }, { "punct", ispunct }, { "space", isspace },
+    { "upper", isupper }, { "xdigit", isxdigit }
+  };
+  Nfa_frag f = set_frag (re);
+  unsigned char *set;
+  const char *s = *p;
+  int negate = 0, first = 1, c, i;
+
+  if (*s == '^')
+    {
+      negate = 1;
+      s++;
+    }
+  while (*s && (*s != ']' || first))
+    {
+      first = 0;
+      if (s[0] == '[' && s[1] == ':')
+	{
+	  const char *end = strstr (s + 2, ":]");
+
+	  for (i = 0; end && i < (int)(sizeof classes / sizeof classes[0]); i++)
+	    if (strlen (classes[i].name) == (size_t)(end - s - 2)
+		&& strncmp (s + 2, classes[i].name, end - s - 2) == 0)
+	      break;
+	  if (!end || i == (int)(sizeof classes / sizeof classes[0]))
+	    {
+	      re->error = "unknown character class";
+	      return f;
+	    }
+	  for (c = 1; c < 256; c++)
+	    if ((*classes[i].is) (c))
+	      add_to_set (re, f, c);
+	  s = end + 2;
+	}
+      else if (s[1] == '-' && s[2] && s[2] != ']')
+	{
+	  for (c = (unsigned char)s[0]; c <= (unsigned char)s[2]; c++)
+	    add_to_set (re, f, c);
+	  s += 3;
+	}
+      else
+	add_to_set (re, f, (unsigned char)*s++);
+    }
+  if (*s != ']')
+    {
+      re->error = "unmatched [";
+      return f;
+    }
+  *p = s + 1;
+  if (negate)
+    {
+      set = re->sets[re->nfa[f.start].set];
+      for (i = 0; i < 32; i++)
+	set[i] = ~set[i];
+      set[0] &= ~1;	/* no NUL */
+    }
+  return f;
+}
+
+/* Parse one atom at *P.  */
+Nfa_frag
+parse_atom (Regex *re, const char **p)
+{
+  Nfa_frag f;
+  int c;
+
+  switch (c = (unsigned char)*(*p)++)
+    {
+      case '(':
+	f = parse_alternatives (re, p);
+	if (**p != ')')
+	  re->error = "unmatched (";
+	else
+	  ++*p;
+	return f;
+      case '[':
+	return parse_bracket (re, p);
+      case '.':
+	f = set_frag (re);
+	memset (re->sets[re->nfa[f.start].set], 0xff, 32);
+	re->sets[re->nfa[f.start].set][0] &= ~1;
+	return f;
+      case '^':
+	return node_frag (re, NFA_BOL);
+      case '$':
+	return node_frag (re, NFA_EOL);
+      case '\\':
+	if (**p == '\0')
+	  {
+	    re->error = "trailing backslash";
+	    return node_frag (re, NFA_EMPTY);
+	  }
+	c = (unsigned char)*(*p)++;
+	/* FALLTHROUGH */
+      default:
+	f = set_frag (re);
+	add_to_set (re, f, c);
+	return f;
+    }
+}
+
+/* Parse an atom and the repetition operators after it.  */
+Nfa_frag
+parse_repeat (Regex *re, const char **p)
+{
+  const char *atom = *p;
+  Nfa_frag f = parse_atom (re, p);
+
+  while (!re->error)
+    {
+      if (**p == '*' || **p == '+')
+	f = star_frag (re, f, *(*p)++ == '+');
+      else if (**p == '?')
+	{
+	  ++*p;
+	  f = alt_frag (re, f, (Nfa_frag *)0);
+	}
+      else if (**p == '{' && isdigit ((unsigned char)(*p)[1]))
+	{
+	  /* Make copies of the atom by parsing it again.  */
+	  char *end;
+	  long min = strtol (*p + 1, &end, 10), max = min, i;
+	  const char *after, *again;
+	  Nfa_frag copy, rest;
+
+	  if (*end == ',')
+	    {
+	      end++;
+	      max = isdigit ((unsigned char)*end) ? strtol (end, &end, 10) : -1;
+	    }
+	  if (*end != '}' || min > 255 || max > 255
+	      || (max >= 0 && max < min))
+	    {
+	      re->error = "bad repetition count";
+	      break;
+	    }
+	  after = end + 1;
+	  if (min == 0)
+	    f = node_frag (re, NFA_EMPTY);
+	  for (i = 1; i < min; i++)
+	    {
+	      again = atom;
+	      f = concat_frag (re, f, parse_atom (re, &again));
+	    }
+	  if (max < 0)
+	    {
+	      again = atom;
+	      f = concat_frag (re, f, star_frag (re, parse_atom (re, &again),
+						 0));
+	    }
+	  for (i = min > 0 ? min : 0; i < max; i++)
+	    {
+	      again = atom;
+	      copy = parse_atom (re, &again);
+	      rest = alt_frag (re, copy, (Nfa_frag *)0);
+	      f = concat_frag (re, f, rest);
+	    }
+	  *p = after;
+	}
+      else
+	break;
+    }
+  return f;
+}
+
+/* Parse a sequence of atoms, up to `|', `)' or the end.  */
+Nfa_frag
+parse_sequence (Regex *re, const char **p)
+{
+  Nfa_frag f = node_frag (re, NFA_EMPTY);
+
+  while (**p && **p != '|' && **p != ')' && !re->error)
+    f = concat_frag (re, f, parse_repeat (re, p));
+  return f;
+}
+
+Nfa_frag
+parse_alternatives (Regex *re, const char **p)
+{
+  Nfa_frag f = parse_sequence (re, p), g;
+
+  while (**p == '|' && !re->error)
+    {
+      ++*p;
+      g = parse_sequence (re, p);
+      f = alt_frag (re, f, &g);
+    }
+  return f;
+}
+
+/* Add NODE and the nodes reachable from it without reading a
+   character to the node list LIST of length *N.  BOL and EOL say
+   whether the topic begins or ends here.  Only the nodes which read
+   characters, match, or wait for the end of the topic are listed.  */
+void
+nfa_closure (Regex *re, int node, int bol, int eol, int *list, int *n)
+{
+  int sp = 0;
+
+  re->stack[sp++] = node;
+  while (sp > 0)
+    {
+      Nfa_node *nn;
+
+      node = re->stack[--sp];
+      if (node < 0 || re->mark[node] == re->generation)
+	continue;
+      re->mark[node] = re->generation;
+      nn = &re->nfa[node];
+      switch (nn->type)
+	{
+	  case NFA_SPLIT:
+	    re->stack[sp++] = nn->out1;
+	    re->stack[sp++] = nn->out;
+	    break;
+	  case NFA_EMPTY:
+	    re->stack[sp++] = nn->out;
+	    break;
+	  case NFA_BOL:
+	    if (bol)
+	      re->stack[sp++] = nn->out;
+	    break;
+	  case NFA_EOL:
+	    list[(*n)++] = node;
+	    if (eol)
+	      re->stack[sp++] = nn->out;
+	    break;
+	  default:
+	    list[(*n)++] = node;
+	    break;
+	}
+    }
+}
+
+int
+compare_ints (const void *p1, const void *p2)
+{
+  int i1 = *(const int *)p1, i2 = *(const int *)p2;
+
+  return i1 < i2 ? -1 : i1 > i2;
+}
+
+/* Find or make the DFA state for the N nodes in LIST.  */
+int
+dfa_state (Regex *re, int *list, int n)
+{
+  unsigned hash = 0;
+  int i, s;
+  Dfa_state *ds;
+
+  qsort (list, n, sizeof (int), compare_ints);
+  for (i = 0; i < n; i++)
+    hash = hash * 31 + list[i];
+  for (s = re->buckets[hash % DFA_BUCKETS]; s >= 0; s = re->dfa[s].chain)
+    if (re->dfa[s].hash == hash && re->dfa[s].nnodes == n
+	&& memcmp (re->dfa[s].nodes, list, n * sizeof (int)) == 0)
+      return s;
+
+  ds = &re->dfa[re->ndfa];
+  ds->nodes = (int *)xmalloc ((n + 1) * sizeof (int));
+  memcpy (ds->nodes, list, n * sizeof (int));
+  ds->nnodes = n;
+  ds->hash = hash;
+  ds->chain = re->buckets[hash % DFA_BUCKETS];
+  re->buckets[hash % DFA_BUCKETS] = re->ndfa;
+  for (i = 0; i < 256; i++)
+    ds->next[i] = -1;
+
+  /* The topic may end here if a match is reachable by passing the
+     ends of the topic in the list.  */
+  ds->accept = 0;
+  re->generation++;
+  for (i = 0; i < n && ds->accept < 2; i++)
+    if (re->nfa[list[i]].type == NFA_MATCH)
+      ds->accept = 2;
+    else if (re->nfa[list[i]].type == NFA_EOL)
+      {
+	int k, m = 0;
+
+	nfa_closure (re, re->nfa[list[i]].out, 0, 1, re->scratch, &m);
+	for (k = 0; k < m; k++)
+	  if (re->nfa[re->scratch[k]].type == NFA_MATCH)
+	    ds->accept = 1;
+      }
+  return re->ndfa++;
+}
+
+/* Forget all the DFA states, and make the start state again.  */
+void
+reset_dfa (Regex *re)
+{
+  int i, n = 0;
+
+  for (i = 0; i < re->ndfa; i++)
+    free (re->dfa[i].nodes);
+  re->ndfa = 0;
+  for (i = 0; i < DFA_BUCKETS; i++)
+    re->buckets[i] = -1;
+  re->generation++;
+  nfa_closure (re, re->start, 1, 0, re->list, &n);
+  dfa_state (re, re->list, n);	/* state 0 */
+}
+
+/* Compile PATTERN.  Returns NULL and says why if it is not valid.  */
+Regex *
+compile_regex (const char *pattern)
+{
+  Regex *re = (Regex *)xmalloc (sizeof (Regex));
+  const char *p = pattern;
+  Nfa_frag f, any;
+  int match;
+
+  memset (re, 0, sizeof (Regex));
+  /* Matches may begin anywhere in the topic: ".*" goes in front.  */
+  any = set_frag (re);
+  memset (re->sets[re->nfa[any.start].set], 0xff, 32);
+  re->sets[re->nfa[any.start].set][0] &= ~1;
+  f = star_frag (re, any, 0);
+  f = concat_frag (re, f, parse_alternatives (re, &p));
+  if (!re->error && *p)
+    re->error = "unmatched )";
+  if (re->error)
+    {
+      fprintf (stderr, "%s: %s in regular expression `%s'\n",
+	       progname, re->error, pattern);
+      free (re->nfa);
+      free (re->sets);
+      free (re);
+      return (Regex *)0;
+    }
+  /* ... and may end anywhere: `regex_matches' stops at the first
+     state which has the match.  NFA_NODE may move RE->NFA, so the node
+     is made before it is linked in.  */
+  match = nfa_node (re, NFA_MATCH, -1, -1);
+  re->nfa[f.end].out = match;
+  re->start = f.start;
+
+  /* A closure pushes at most two nodes for each node it visits.  */
+  re->stack = (int *)xmalloc (2 * (re->nnfa + 1) * sizeof (int));
+  re->mark = (int *)xmalloc (re->nnfa * sizeof (int));
+  memset (re->mark, 0, re->nnfa * sizeof (int));
+  re->list = (int *)xmalloc ((re->nnfa + 1) * sizeof (int));
+  re->scratch = (int *)xmalloc ((re->nnfa + 1) * sizeof (int));
+  re->dfa = (Dfa_state *)xmalloc (DFA_MAX_STATES * sizeof (Dfa_state));
+  reset_dfa (re);
+  return re;
+}
+
+void
+free_regex (Regex *re)
+{
+  int i;
+
+  for (i = 0; i < re->ndfa; i++)
+    free (re->dfa[i].nodes);
+  free (re->dfa);
+  free (re->nfa);
+  free (re->sets);
+  free (re->stack);
+  free (re->mark);
+  free (re->list);
+  free (re->scratch);
+  free (re);
+}
+
+/* Non-zero if the N characters at TEXT have a match of RE.  */
+int
+regex_matches (Regex *re, const char *text, size_t n)
+{
+  int state = 0;
+
+  while (n-- > 0 && re->dfa[state].accept < 2)
+    {
+      int c = (unsigned char)*text++;
+      int next = re->dfa[state].next[c];
+
+      if (next < 0)
+	{
+	  /* Make the transition: the closures of the nodes C leads to.  */
+	  Dfa_state *ds = &re->dfa[state];
+	  int i, m = 0;
+
+	  re->generation++;
+	  for (i = 0; i < ds->nnodes; i++)
+	    {
+	      Nfa_node *nn = &re->nfa[ds->nodes[i]];
+
+	      if (nn->type == NFA_SET
+		  && (re->sets[nn->set][c >> 3] & (1 << (c & 7))))
+		nfa_closure (re, nn->out, 0, 0, re->list, &m);
+	    }
+	  if (re->ndfa >= DFA_MAX_STATES)
+	    {
+	      /* Start over, keeping the nodes of the next state.  */
+	      int *saved = (int *)xmalloc ((m + 1) * sizeof (int));
+
+	      memcpy (saved, re->list, m * sizeof (int));
+	      reset_dfa (re);
+	      next = dfa_state (re, saved, m);
+	      free (saved);
+	    }
+	  else
+	    {
+	      next = dfa_state (re, re->list, m);
+	      re->dfa[state].next[c] = next;
+	    }
+	}
+      state = next;
+    }
+  return re->dfa[state].accept > 0;
+}
+
+/* The topic and section of page file NAME, as lengths into NAME and
+   a pointer to the section suffix.  Compressed files keep the
+   compression suffix out of both.  */
+void
+split_page_name (const char *name, size_t *topic_len, const char **section,
+		 size_t *section_len)
+{
+  const char *end = name + strlen (name), *dot;
+
+  if (not_a_page (name) && (dot = strrchr (name, '.')) != 0)
+    end = dot;
+  for (dot = end; dot > name && dot[-1] != '.'; dot--)
+    ;
+  if (dot > name + 1)
+    {
+      *topic_len = dot - 1 - name;
+      *section = dot;
+      *section_len = end - dot;
+    }
+  else
+    {
+      *topic_len = end - name;
+      *section = end;
+      *section_len = 0;
+    }
+}
+
+/* With --regex, print page PAGE if its topic matches.  */
+void
+regex_page (const Man_page *page)
+{
+  size_t topic_len, section_len;
+  const char *section;
+
+  if (page->name[0] == '.')	/* ".." and the like are no pages */
+    return;
+  split_page_name (page->name, &topic_len, &section, &section_len);
+  if (regex_matches (topic_regex, page->name, topic_len))
+    {
+      printf ("%.*s\t%.*s\t%s\n", (int)section_len, section, (int)topic_len,
+	      page->name, page->path);
+      regex_found++;
+    }
+}
+
+/* The files of the pages found by one lookup, by identity, so that a
+   file found under several names (hard or symbolic links) is read and
+   displayed only once.  */
+typedef struct page_file {
+  unsigned long dev, ino;
+  unsigned flags;		/* what `set_flags' said about it */
+  Man_page *kept;		/* with -a, the page stored for it */
+  struct page_file *next;
+} Page_file;
+
+#define PAGE_FILE_BUCKETS 256
+static Page_file *page_files[PAGE_FILE_BUCKETS];
+
+/* Forget the page files of the previous lookup.  */
+void
+forget_page_files (void)
+{
+  int i;
+
+  for (i = 0; i < PAGE_FILE_BUCKETS; i++)
+    while (page_files[i])
+      {
+	Page_file *next = page_files[i]->next;
+
+	free (page_files[i]);
+	page_files[i] = next;
+      }
+}
+
+/* Compute the formatting flags of page FILE, reading them from FD if
+   it is not -1; FD is closed.  */
+unsigned
+page_flags (const char *file, int fd)
+{
+  FILE *fp;
+
+  if (fd < 0)
+    return set_flags (file);
+  if ((fp = fdopen (fd, "rt")) == 0)
+    {
+      close (fd);
+      return set_flags (file);
+    }
+  return read_flags (fp, file);
+}
+
+/* Put the formatting flags of page file FILE into *FLAGS, and set
+   *SEEN if FILE is the same file as a page found before in this
+   lookup, whose flags are used then instead of reading it again.  FD
+   is FILE opened by `prefetch_headers', or -1; it is closed.  Returns
+   the record of the file, or NULL if files can't be told apart
+   here.  */
+Page_file *
+classify_page (const char *file, int fd, unsigned *flags, int *seen)
+{
+#if !defined (MSDOS) && !defined (__WIN32__)
+  struct stat st;
+  Page_file *pf;
+  unsigned long bucket;
+
+  if (fd >= 0 ? fstat (fd, &st) == 0 : stat (file, &st) == 0)
+    {
+      bucket = ((unsigned long)st.st_ino * 31 + (unsigned long)st.st_dev)
+	       % PAGE_FILE_BUCKETS;
+      for (pf = page_files[bucket]; pf; pf = pf->next)
+	if (pf->ino == (unsigned long)st.st_ino
+	    && pf->dev == (unsigned long)st.st_dev)
+	  {
+	    *flags = pf->flags;
+	    *seen = 1;
+	    if (fd >= 0)
+	      close (fd);
+	    return pf;
+	  }
+      pf = (Page_file *)xmalloc (sizeof (Page_file));
+      pf->dev = (unsigned long)st.st_dev;
+      pf->ino = (unsigned long)st.st_ino;
+      pf->flags = *flags = page_flags (file, fd);
+      pf->kept = (Man_page *)0;
+      pf->next = page_files[bucket];
+      page_files[bucket] = pf;
+      *seen = 0;
+      return pf;
+    }
+#endif
+  /* No inode numbers to tell links apart by.  */
+  *flags = page_flags (file, fd);
+  *seen = 0;
+  return (Page_file *)0;
+}
+
+/* PAGE is another name of the file of KEPT, a stored page.  Keep the
+   name which sorts first in KEPT, and free PAGE.  */
+void
+keep_better_name (Man_page *kept, Man_page *page)
+{
+  unsigned long key = (unsigned long)page->section * (FMT_MASK + 1)
+		      + (page->flags & FMT_MASK);
+
+  if (key < kept->key)
+    {
+      free (kept->path);
+      kept->path = page->path;
+      kept->name = page->name;
+      kept->section = page->section;
+      kept->key = key;
+    }
+  else
+    free (page->path);
+  free (page);
+}
+
+/* Deal with a page `try_directory' found, as PAGE_MODE says.  */
+void
+take_page (Man_page *page)
+{
+  if (page_mode == LIST_PAGES || page_mode == MATCH_REGEX)
+    {
+      if (page_mode == LIST_PAGES)
+	list_page (page);
+      else
+	regex_page (page);
+      free (page->path);
+      free (page);
+      return;
+    }
+  add_page (page);
+
+  /* Keep the page the list would end with if it were sorted.  */
+  if (page_mode == KEEP_FIRST && next_slot == 2)
+    {
+      if (compare_pages (&pages[1], &pages[0]) > 0)
+	{
+	  pages[1] = pages[0];
+	  pages[0] = page;
+	}
+      remove_page (1);
+    }
+}
+
+/* Deal with PAGE, a page file found in this lookup, as `take_page'
+   does, but store a file which was found before under another name
+   only once.  FD is the file opened by `prefetch_headers', or -1; it
+   is closed.  */
+void
+take_page_file (Man_page *page, int fd)
+{
+  int seen;
+  Page_file *pf;
+
+  /* Listing needs no header: the pages are not sorted, and every name
+     is listed, links or not.  */
+  if (page_mode == LIST_PAGES || page_mode == MATCH_REGEX)
+    {
+      if (fd >= 0)
+	close (fd);
+      page->flags = 0;
+      take_page (page);
+      return;
+    }
+  pf = classify_page (page->path, fd, &page->flags, &seen);
+  if (pf && seen && page_mode == KEEP_DISTINCT)
+    {
+      if (debugging_output)
+	fprintf (stderr, "`%s': same file as `%s'\n",
+		 page->path, pf->kept->path);
+      keep_better_name (pf->kept, page);
+      return;
+    }
+  take_page (page);
+  if (pf && page_mode == KEEP_DISTINCT)
+    pf->kept = page;
+}
+
+
+/* Remembering misses.
+
+   Scripts probe for optional pages over and over, and a page which is
+   not there is the dearest lookup of all: every directory is read.  So
+   when a lookup finds nothing, its key (the topic, the section, the
+   search path and the locales) is written to the file MISS_NAME in
+   the private directory, with the modification times of all the
+   directories it looked in.  While none of them changes, the same
+   lookup finds nothing again at the cost of a `stat' for each.
+
+   A topic which has no translation is looked for in each locale
+   subtree before the untranslated pages are, and found there.  So a
+   lookup also remembers, under a key of its own, each locale subtree
+   in which it found nothing, and skips the subtree the next time.  */
+
+#define MISS_NAME	"manmiss.dat"
+#define MISS_MAGIC	"man misses 1\n"
+#define MAX_MISSES	64
+
+typedef struct {
+  char *key;
+  int ndirs;
+  char **dirs;
+  unsigned long *mtimes;
+  char *absent;		/* non-zero for a directory which did not exist */
+} Miss;
+
+static Miss *misses;
+static int nmisses = -1;	/* -1 until the file is read */
+
+/* Zero to leave the misses file alone, as the worker of --speculate
+   does.  */
+static int remember_misses = 1;
+
+/* The directories the lookup under way looked in, while RECORDING.  */
+static char **scanned;
+static int nscanned, max_scanned, recording;
+
+/* Start noting the directories a lookup looks in.  */
+void
+start_recording (void)
+{
+  while (nscanned > 0)
+    free (scanned[--nscanned]);
+  recording = 1;
+}
+
+/* Note that the lookup under way looks in directory DIR.  */
+void
+note_scanned_dir (const char *dir)
+{
+  if (!recording)
+    return;
+  if (nscanned >= max_scanned)
+    {
+      max_scanned = max_scanned ? 2 * max_scanned : 32;
+      scanned = (char **)xrealloc (scanned, max_scanned * sizeof (char *));
+    }
+  scanned[nscanned] = (char *)xmalloc (strlen (dir) + 1);
+  strcpy (scanned[nscanned++], dir);
+}
+
+void
+free_miss (Miss *m)
+{
+  int i;
+
+  for (i = 0; i < m->ndirs; i++)
+    free (m->dirs[i]);
+  free (m->dirs);
+  free (m->mtimes);
+  free (m->absent);
+  free (m->key);
+}
+
+/* Add a directory to miss M.  */
+void
+add_miss_dir (Miss *m, const char *dir, unsigned long mtime, int absent)
+{
+  m->dirs = (char **)xrealloc (m->dirs, (m->ndirs + 1) * sizeof (char *));
+  m->mtimes = (unsigned long *)xrealloc (m->mtimes, (m->ndirs + 1)
+					 * sizeof (unsigned long));
+  m->absent = (char *)xrealloc (m->absent, m->ndirs + 1);
+  m->dirs[m->ndirs] = (char *)xmalloc (strlen (dir) + 1);
+  strcpy (m->dirs[m->ndirs], dir);
+  m->mtimes[m->ndirs] = mtime;
+  m->absent[m->ndirs++] = absent;
+}
+
+/* Read the misses file, once.  */
+void
+read_misses (void)
+{
+  char name[FILENAME_MAX], line[3 * FILENAME_MAX];
+  const char *private = private_dir ();
+  FILE *fp;
+
+  if (nmisses >= 0)
+    return;
+  nmisses = 0;
+  if (!private)
+    return;
+  sprintf (name, "%s/%s", private, MISS_NAME);
+  if ((fp = fopen (name, "r")) == 0)
+    return;
+  if (!fgets (line, sizeof line, fp) || strcmp (line, MISS_MAGIC) != 0)
+    {
+      fclose (fp);
+      return;
+    }
+  while (fgets (line, sizeof line, fp))
+    {
+      size_t len = strlen (line);
+      unsigned long mtime;
+      int skip;
+
+      if (len > 0 && line[len - 1] == '\n')
+	line[--len] = '\0';
+      if (line[0] == 'K' && line[1] == ' ')
+	{
+	  misses = (Miss *)xrealloc (misses, (nmisses + 1) * sizeof (Miss));
+	  memset (&misses[nmisses], 0, sizeof (Miss));
+	  misses[nmisses].key = (char *)xmalloc (len - 1);
+	  strcpy (misses[nmisses++].key, line + 2);
+	}
+      else if (nmisses > 0 && line[0] == 'D' && line[1] == ' ')
+	{
+	  if (line[2] == '-' && line[3] == ' ')
+	    add_miss_dir (&misses[nmisses - 1], line + 4, 0, 1);
+	  else if (sscanf (line + 2, "%lu %n", &mtime, &skip) == 1)
+	    add_miss_dir (&misses[nmisses - 1], line + 2 + skip, mtime, 0);
+	}
+    }
+  fclose (fp);
+}
+
+/* Write the misses file.  */
+void
+write_misses (void)
+{
+  char name[FILENAME_MAX], temp[FILENAME_MAX];
+  const char *private = private_dir ();
+  FILE *fp;
+  int i, j;
+
+  if (!private)
+    return;
+  sprintf (name, "%s/%s", private, MISS_NAME);
+  if ((fp = make_temp (private, temp, "w")) == 0)
+    return;
+  fputs (MISS_MAGIC, fp);
+  for (i = 0; i < nmisses; i++)
+    {
+      fprintf (fp, "K %s\n", misses[i].key);
+      for (j = 0; j < misses[i].ndirs; j++)
+	if (misses[i].absent[j])
+	  fprintf (fp, "D - %s\n", misses[i].dirs[j]);
+	else
+	  fprintf (fp, "D %lu %s\n", misses[i].mtimes[j], misses[i].dirs[j]);
+    }
+  if (fclose (fp) || replace_file (temp, name))
+    remove (temp);
+}
+
+/* The key of a lookup for topic NAME in SECTION, in malloc'ed
+   storage.  */
+char *
+miss_key (const char *section, const char *name)
+{
+  const char *roots = search_roots ();
+  size_t len = strlen (name) + strlen (section) + strlen (roots) + 4;
+  char *key;
+  int i;
+
+  for (i = 0; i < nlocales; i++)
+    len += strlen (locale_names[i]) + 1;
+  key = (char *)xmalloc (len);
+  sprintf (key, "%s\t%s\t%s\t", name, section, roots);
+  for (i = 0; i < nlocales; i++)
+    sprintf (key + strlen (key), "%s%s", i ? "," : "", locale_names[i]);
+  return key;
+}
+
+/* The key of a lookup for topic NAME in SECTION in the locale subtree
+   SUBTREE alone, in malloc'ed storage.  */
+char *
+subtree_miss_key (const char *section, const char *name,
+		  const char *subtree)
+{
+  char *key = (char *)xmalloc (strlen (name) + strlen (section)
+			       + strlen (subtree) + 3);
+
+  sprintf (key, "%s\t%s\t%s", name, section, subtree);
+  return key;
+}
+
+/* Non-zero if a lookup by KEY found nothing before, and none of the
+   directories it looked in changed since.  Those directories are
+   noted as looked in by the lookup under way, if any.  */
+int
+known_miss (const char *key)
+{
+  unsigned long dev, ino, mtime;
+  int i, j;
+
+  read_misses ();
+  for (i = 0; i < nmisses && strcmp (misses[i].key, key); i++)
+    ;
+  if (i == nmisses)
+    return 0;
+  for (j = 0; j < misses[i].ndirs; j++)
+    {
+      int absent = dir_identity (misses[i].dirs[j], &dev, &ino, &mtime) != 0;
+
+      if (absent != misses[i].absent[j]
+	  || (!absent && mtime != misses[i].mtimes[j]))
+	{
+	  if (debugging_output)
+	    fprintf (stderr, "`%s' changed since the last miss\n",
+		     misses[i].dirs[j]);
+	  return 0;
+	}
+    }
+  if (debugging_output)
+    fprintf (stderr, "Known miss: none of %d directories changed\n",
+	     misses[i].ndirs);
+  for (j = 0; j < misses[i].ndirs; j++)
+    note_scanned_dir (misses[i].dirs[j]);
+  return 1;
+}
+
+/* Remember that the lookup by KEY, which looked in the directories
+   noted by `note_scanned_dir' from the FIRST on, found nothing.  */
+void
+remember_miss (const char *key, int first)
+{
+  unsigned long dev, ino, mtime;
+  unsigned long started = (unsigned long)time ((time_t *)0);
+  Miss m;
+  int i;
+
+  if (!remember_misses)
+    return;
+  memset (&m, 0, sizeof m);
+  for (i = first; i < nscanned; i++)
+    {
+      if (dir_identity (scanned[i], &dev, &ino, &mtime) != 0)
+	add_miss_dir (&m, scanned[i], 0, 1);
+      else if (mtime + 2 > started)
+	{
+	  /* A change within the same second would go unnoticed.  */
+	  free_miss (&m);
+	  return;
+	}
+      else
+	add_miss_dir (&m, scanned[i], mtime, 0);
+    }
+  m.key = (char *)xmalloc (strlen (key) + 1);
+  strcpy (m.key, key);
+
+  /* The new miss replaces an old one by the same key, and the oldest
+     ones go when there are too many.  */
+  read_misses ();
+  for (i = 0; i < nmisses; i++)
+    if (strcmp (misses[i].key, key) == 0)
+      {
+	free_miss (&misses[i]);
+	memmove (misses + i, misses + i + 1, (nmisses - i - 1) * sizeof (Miss));
+	nmisses--;
+	break;
+      }
+  if (nmisses >= MAX_MISSES)
+    {
+      free_miss (&misses[0]);
+      memmove (misses, misses + 1, (nmisses - 1) * sizeof (Miss));
+      nmisses--;
+    }
+  misses = (Miss *)xrealloc (misses, (nmisses + 1) * sizeof (Miss));
+  misses[nmisses++] = m;
+  write_misses ();
+}
+
+/* Directory entries are read in blocks of this many names, and each
+   block is matched against all the patterns in one go.  */
+#define DIR_BLOCK	64
+
+/* Bits in the match masks `fnmatch_batch' returns for a block.  */
+#define MATCH_FILE	0x01	/* the page file pattern */
+#define MATCH_SUBDIR	0x06	/* either of the manN and catN patterns */
+
+/* When only the page which sorts first is wanted (KEEP_FIRST), the
+   one kept so far is all a new page has to beat.  The section of a
+   page, which comes from its name, is the major part of its sort key,
+   so a page whose section alone puts it after the kept one cannot win
+   whatever its header says, and need not be opened at all.  Pages
+   which tie go to the one found last, so the directories themselves
+   must all still be read.  */
+int
+cannot_win (const char *name)
+{
+  if (page_mode != KEEP_FIRST || next_slot == 0)
+    return 0;
+  return (unsigned long)set_section (name) * (FMT_MASK + 1) > pages[0]->key;
+}
+
+/* Reading page headers ahead.
+
+   Classifying a page reads its first line, and when a directory has
+   many pages which match, waiting for each of those reads in turn
+   adds up on a cold cache, a slow disk or a network mount.  So the
+   pages of each block of directory entries are all opened first, and
+   the system is told that their beginnings will be read soon, which
+   lets it read them all at once; the pages are then classified from
+   the open descriptors.  Where posix_fadvise is missing, each page is
+   opened only when it is classified.  */
+
+#if !defined (MSDOS) && !defined (__WIN32__) && defined (POSIX_FADV_WILLNEED)
+# define PREFETCH_HEADERS
+#endif
+
+/* How much of each page to ask for ahead.  Only the first line is
+   read, but the system reads at least a block anyway.  */
+#define HEADER_BYTES	512
+
+/* Open the entries among the NNAMES names in NAMES which MATCHES says
+   are page files, putting their descriptors in FDS, and ask for their
+   headers to be read ahead.  ENTRY_NAME holds the directory name and
+   a slash in its first DIRLEN + 1 characters.  Entries which were not
+   opened get -1; once we run out of descriptors, no more are opened.  */
+void
+prefetch_headers (char *entry_name, size_t dirlen, const char **names,
+		  const unsigned *matches, int nnames, int *fds)
+{
+  int i, out_of_fds = 0;
+
+  for (i = 0; i < nnames; i++)
+    {
+      fds[i] = -1;
+#ifdef PREFETCH_HEADERS
+      if ((matches[i] & MATCH_FILE) && !(matches[i] & MATCH_SUBDIR)
+	  && !out_of_fds && !cannot_win (names[i]))
+	{
+	  strcpy (entry_name + dirlen + 1, names[i]);
+	  if ((fds[i] = open (entry_name, O_RDONLY)) >= 0)
+	    posix_fadvise (fds[i], 0, HEADER_BYTES, POSIX_FADV_WILLNEED);
+	  else
+	    out_of_fds = (errno == EMFILE || errno == ENFILE);
+	}
+#endif
+    }
+}
+
+/* Probing for a page.
+
+   When the topic and the section are given in full, like "printf" in
+   section "3p", the pattern has no wildcards: "printf.3p" in the top
+   directory and in its "man3" and "cat3" subdirectories are the only
+   names which can match.  Rather than reading those directories, we
+   then just see which of the names exist, and make a listing of them
+   for `try_directory'.  This is not done where names are truncated
+   or case does not matter, since the file found may then be named
+   otherwise than the pattern; the directories are read there.  */
+
+/* The page file name being probed for, or null when reading the
+   directories.  */
+static const char *probe_name;
+
+/* Non-zero if the names of files in directory DIR are told apart by
+   case, as far as we can tell.  */
+int
+case_sensitive_dir (const char *dir)
+{
+#if defined (MSDOS) || defined (__WIN32__)
+  (void)dir;
+  return 0;
+#elif defined (_PC_CASE_SENSITIVE)
+  return pathconf (dir, _PC_CASE_SENSITIVE) != 0;
+#else
+  (void)dir;
+  return 1;
+#endif
+}
+
+/* Make a listing in LISTING of the names in directory DIR which may
+   match PROBE_NAME or, if RECURSE_OK, the subdirectory patterns,
+   using NAMES for the names.  Returns LISTING, or null if DIR is not
+   a directory.  */
+const Dir_listing *
+probe_listing (const char *dir, int recurse_ok, Dir_listing *listing,
+	       char **names)
+{
+  char path[FILENAME_MAX];
+  const char *candidates[3];
+  struct stat st;
+  int i;
+
+  if (!isadir ((char *)dir))
+    return (Dir_listing *)0;
+  candidates[0] = probe_name;
+  candidates[1] = dir_pattern1;
+  candidates[2] = dir_pattern2;
+  listing->name = dir;
+  listing->count = 0;
+  listing->names = names;
+  listing->storage = (char *)0;
+  for (i = 0; i < (recurse_ok ? 3 : 1); i++)
+    {
+      sprintf (path, "%s/%s", dir, candidates[i]);
+      /* A dangling symbolic link is listed too, as reading the
+	 directory would.  */
+#if !defined (MSDOS) && !defined (__WIN32__)
+      if (lstat (path, &st) == 0)
+#else
+      if (stat (path, &st) == 0)
+#endif
+	names[listing->count++] = (char *)candidates[i];
+    }
+  if (debugging_output)
+    fprintf (stderr, "Probed `%s': %d of %d names there\n", dir,
+	     listing->count, recurse_ok ? 3 : 1);
+  return listing;
+}
+
+/*  Find all man page files in directory DIR and, if RECURSE_OK is
+    set, in its first-level subdirectories man* and cat*.
+    Returns the number of found pages, or -1 in case of fatal errors.  */
+int
+try_directory (const char *dir, const char *file_pattern, int recurse_ok)
+{
+  size_t dirlen = strlen (dir);
+  DIR *dp = (DIR *)0;
+  struct dirent *de;
+  const Dir_listing *listing = (Dir_listing *)0;
+  Dir_listing probed;
+  char *probed_names[3];
+  int next_name = 0;
+  int found = 0;
+  char cat_name[PATH_MAX];
+  int try_cat_dir = 0;
+  char entry_name[PATH_MAX];
+  const char *patterns[3];
+  int pattern_flags[3];
+  const char *names[DIR_BLOCK];
+  size_t offsets[DIR_BLOCK];
+  unsigned matches[DIR_BLOCK];
+  int fds[DIR_BLOCK];
+  char *pool;
+  size_t pool_size = DIR_BLOCK * 16;
+
+  note_scanned_dir (dir);
+
+  /* Take the names from the snapshot in --batch mode, or from the
+     index if it has them and they are still current, otherwise read
+     the directory.  */
+  if (use_snapshot)
+    {
+      if ((listing = snapshot_listing (dir)) == 0)
+	return -1;
+    }
+  else if (probe_name)
+    listing = probe_listing (dir, recurse_ok, &probed, probed_names);
+  else if (current_index && !recurse_ok)
+    {
+      listing = find_listing (current_index,
+			      dir + strlen (current_index->top) + 1);
+      if (listing && !listing_is_current (listing, dir))
+	{
+	  if (debugging_output)
+	    fprintf (stderr, "`%s' changed since it was indexed\n", dir);
+	  listing = (Dir_listing *)0;
+	}
+    }
+  if (!listing && (dp = opendir (dir)) == 0)
+    {
+      if (verbose_option)
+	fprintf (stderr, "%s: cannot look inside %s: %s\n",
+		 progname, dir, strerror (errno));
+      return -1;
+    }
+
+  if (debugging_output)
+    fprintf (stderr, "Looking in `%s'%s for `%s'\n", dir,
+	     listing == &probed ? " (probed)"
+	     : listing ? " (indexed)" : "", file_pattern);
+
+  if (!recurse_ok
+#ifdef __TURBOC__
+      && strnicmp (dir + dirlen - 5, "/man", 4) == 0
+#else
+      && strncmp (dir + dirlen - 5, "/man", 4) == 0
+#endif
+      && strchr (section_letters, dir[dirlen-1]))
+    {
+      try_cat_dir = 1;
+      /* Create a name of the sibling catN directory.  */
+      memcpy (cat_name, dir, dirlen - 4);
+      memcpy (cat_name + dirlen - 4, "cat", 3);
+      cat_name[dirlen - 1] = dir[dirlen - 1];
+      cat_name[dirlen] = '/';
+    }
+
+  /* Page files are looked for everywhere; manN and catN subdirectories
+     only if we may recurse into them.  */
+  patterns[0] = file_pattern;
+  pattern_flags[0] = MATCHFLAGS;
+  patterns[1] = dir_pattern1;
+  pattern_flags[1] = 0;
+  patterns[2] = dir_pattern2;
+  pattern_flags[2] = MATCHFLAGS;
+
+  strcat (strcpy (entry_name, dir), "/");
+  pool = (char *)xmalloc (pool_size);
+  for (;;)
+    {
+      int nnames = 0, i;
+      size_t used = 0;
+
+      /* Collect a block of entries, then match all of them at once.
+	 `readdir' may reuse its buffer, so the names are copied.  */
+      while (nnames < DIR_BLOCK)
+	{
+	  const char *d_name;
+	  size_t len;
+
+	  if (listing)
+	    d_name = (next_name < listing->count
+		      ? listing->names[next_name++] : (char *)0);
+	  else
+	    d_name = (de = readdir (dp)) != 0 ? de->d_name : (char *)0;
+	  if (!d_name)
+	    break;
+	  if (recurse_ok && is_index_file (d_name))
+	    continue;
+	  len = strlen (d_name) + 1;
+	  if (used + len > pool_size)
+	    {
+	      pool_size = 2 * pool_size + len;
+	      pool = (char *)xrealloc (pool, pool_size);
+	    }
+	  memcpy (pool + used, d_name, len);
+	  offsets[nnames++] = used;
+	  used += len;
+	}
+      if (nnames == 0)
+	break;
+      for (i = 0; i < nnames; i++)
+	names[i] = pool + offsets[i];
+      fnmatch_batch (patterns, pattern_flags, recurse_ok ? 3 : 1,
+		     names, nnames, matches);
+      if (page_mode == LIST_PAGES || page_mode == MATCH_REGEX)
+	for (i = 0; i < nnames; i++)
+	  fds[i] = -1;
+      else
+	prefetch_headers (entry_name, dirlen, names, matches, nnames, fds);
+
+      for (i = 0; i < nnames; i++)
+	{
+	  const char *name = names[i];
+
+	  if (!matches[i])
+	    continue;
+	  strcpy (entry_name + dirlen + 1, name);
+
+	  /* If found a subdirectory like manN or catN, recurse into it.  */
+	  if (matches[i] & MATCH_SUBDIR)
+	    {
+	      if (use_snapshot
+		  ? snapshot_listing (entry_name) != 0 : isadir (entry_name))
+		{
+		  if (debugging_output)
+		    fprintf (stderr, "`%s': a directory, recursing\n",
+			     entry_name);
+		  found += try_directory (entry_name, file_pattern, 0);
+		}
+	    }
+	  else if (matches[i] & MATCH_FILE)
+	    {
+	      char *full_name;
+	      Man_page *page;
+
+	      /* "." and ".." match "*", but they are no pages.  */
+	      if (name[0] == '.'
+		  && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+		{
+		  if (fds[i] >= 0)
+		    close (fds[i]);
+		  fds[i] = -1;
+		  continue;
+		}
+	      if (cannot_win (name))
+		{
+		  if (debugging_output)
+		    fprintf (stderr, "`%s': skipped (sorts after `%s')\n",
+			     entry_name, pages[0]->path);
+		  found++;
+		  continue;
+		}
+
+	      /* If a file by the same name exists in a sibling catN
+		 directory, don't add the file from manN directory to the
+		 list, because the formatted file from the catN directory
+		 will be used.  */
+	      if (try_cat_dir)
+		{
+		  strcpy (cat_name + dirlen + 1, name);
+		  if (access (cat_name, R_OK) == 0 && isadir (cat_name))
+		    {
+		      if (debugging_output)
+			fprintf (stderr,
+				 "`%s': rejected (formatted version found)\n",
+				 entry_name);
+		      if (fds[i] >= 0)
+			close (fds[i]);
+		      fds[i] = -1;
+		      continue;
+		    }
+		}
+
+	      full_name = (char *)xmalloc (dirlen + strlen (name) + 2);
+	      page  = (Man_page *)xmalloc (sizeof (Man_page));
+
+	      if (debugging_output)
+		fprintf (stderr, "`%s': accepted\n", entry_name);
+	      strcpy (full_name, entry_name);
+	      page->path = full_name;
+	      page->name = full_name + dirlen + 1;
+	      page->section = set_section (page->name);
+	      found++;
+	      take_page_file (page, fds[i]);
+	      fds[i] = -1;
+	    }
+	}
+      /* Close the pages which were opened but not taken.  */
+      for (i = 0; i < nnames; i++)
+	if (fds[i] >= 0)
+	  close (fds[i]);
+    }
+  free (pool);
+  if (dp)
+    closedir (dp);
+  return found;
+}
+
+/* Look for pages matching FILE_PATTERN in TOP, a MANPATH directory or
+   a locale subtree of one.  */
+int
+search_tree (const char *top, const char *file_pattern)
+{
+  int found;
+
+  current_index = get_index (top);
+  if (current_index->ndirs == 0)
+    current_index = (Man_index *)0;
+  found = try_directory (top, file_pattern, 1);
+  current_index = (Man_index *)0;
+  return found;
+}
+
+/* Put into EXT, which has room for 10 characters, the pattern which
+   the extension of a page in SECTION matches, with its dot:
+
+     "3"  -> ".3*"
+     "3v" -> ".3v"
+     "new" -> ".[1-9]?"
+     "*"  -> ".[!iz]*"  (so we don't find .info and .zip files)  */
+void
+section_pattern (const char *section, char *ext)
+{
+  size_t extlen = 0;
+
+  ext[extlen++] = '.';
+  if (isdigit (*section))
+    {
+      ext[extlen++] = *section++;
+      if (*section)
+	ext[extlen++] = *section;
+      else
+	ext[extlen++] = '*';
+      ext[extlen++] = '\0';
+    }
+  else if (strchr (section_letters, *section))
+    strcpy (ext + extlen, "[1-9]?");
+  else
+    strcpy (ext + extlen, "[!iz]*");
+}
+
+int
+find_pages (const char *section, const char *name)
+{
+  char this_dir[FILENAME_MAX], file_pattern[FILENAME_MAX];
+  char locale_dir[FILENAME_MAX];
+  char base[FILENAME_MAX], ext[10];
+  const char *list = search_roots ();
+  char *key;
+  int found_pages = 0;
+  size_t namelen = strlen (name);
+#ifdef MSDOS
+  int truncate_long_names = 1;
+#else  /* not MSDOS */
+  int truncate_long_names = 0;
+#endif /* not MSDOS */
+
+  forget_page_files ();
+  key = miss_key (section, name);
+  if (known_miss (key))
+    {
+      free (key);
+      return 0;
+    }
+  start_recording ();
+
+  /* Look in either "manN" and "catN" or "man?" and "cat?" subdirs.  */
+  dir_pattern1[3] = dir_pattern2[3] = (*section == '*' ? '?' :  *section);
+
+  /* Generate the pattern "name.section"  */
+  memcpy (base, name, namelen + 1);
+  section_pattern (section, ext);
+
+  /* Try each directory in MANPATH.  */
+  while (next_path_dir (&list, this_dir))
+    {
+      unsigned present = locale_subtrees (this_dir);
+      int this_found, i;
+
+#ifdef __DJGPP__
+      /* DJGPP's support of long file names depends on whether the
+	 filesystem where THIS_DIR resides supports long names.  */
+      truncate_long_names = !_use_lfn (this_dir);
+#endif
+      /* If NAME is longer than 8 characters, we will never find it using
+	 `fnmatch' if file names are truncated by the filesystem.  We
+	 need to truncate the topic name as well.  */
+      if (truncate_long_names && namelen > 8)
+	{
+	  file_pattern[0] = '\0';
+	  strncat (file_pattern, base, 8);
+	}
+      else
+	strcpy (file_pattern, base);
+
+      strcat (file_pattern, ext);
+
+      /* A pattern without wildcards need not be looked for by
+	 reading the directories.  */
+      if (!use_snapshot && !truncate_long_names && MATCHFLAGS == 0
+	  && !strpbrk (file_pattern, "*?[\\/")
+	  && !strpbrk (dir_pattern1, "*?[\\")
+	  && case_sensitive_dir (this_dir))
+	probe_name = file_pattern;
+      else
+	probe_name = (char *)0;
+
+      /* Pages in the most specific locale subtree which has any are
+	 used; the untranslated ones only if no subtree has them.  */
+      this_found = 0;
+      for (i = 0; i < nlocales && this_found <= 0; i++)
+	if ((present & (1 << i))
+	    && strlen (this_dir) + strlen (locale_names[i]) + 2
+	       <= sizeof locale_dir)
+	  {
+	    char *subtree_key;
+	    int first = nscanned;
+
+	    strcat (strcat (strcpy (locale_dir, this_dir), "/"),
+		    locale_names[i]);
+	    subtree_key = subtree_miss_key (section, name, locale_dir);
+	    if (!known_miss (subtree_key)
+		&& (this_found = search_tree (locale_dir, file_pattern)) == 0)
+	      remember_miss (subtree_key, first);
+	    free (subtree_key);
+	  }
+      if (this_found <= 0)
+	this_found = search_tree (this_dir, file_pattern);
+      if (this_found > 0)
+	found_pages += this_found;
+    }
+  probe_name = (char *)0;
+  recording = 0;
+  if (found_pages == 0)
+    remember_miss (key, 0);
+  free (key);
+  return found_pages;
+}
+
+/* Given a page with its formatting flags, build a command line to
+   format that page with the Groff command GROFF.  */
+char *
+formatter_cmd (const Man_page *page, const char *groff)
+{
+  static char fmt_cmd[FILENAME_MAX + 3*5 + 1]; /* 5: known preprocessors */
+  unsigned flags = page->flags;
+
+  if (flags & FLAG_CANT_OPEN)	/* file couldn't be accessed */
+    {
+      fprintf (stderr, "%s: Impossible: %s is inaccessible\n",
+	       progname, page->path);
+      exit (3);
+    }
+  else if (flags & FLAG_FORMATTED)
+    return (char *)0;	/* no formatter required */
+
+  strcpy (fmt_cmd, groff);
+
+  if (flags & FLAG_SOELIM)
+    strcat (fmt_cmd, " -s");	/* I think Groff doesn't need this... */
+  if (flags & FLAG_EQN)
+    strcat (fmt_cmd, " -e");
+  if (flags & FLAG_REFER)
+    strcat (fmt_cmd, " -R");
+  if (flags & FLAG_TBL)
+    strcat (fmt_cmd, " -t");
+  if (flags & FLAG_VGRIND)
+    fprintf (stderr, "%s: vgrind preprocessing not supported!\n",
+	     progname);
+
+  return fmt_cmd;
+}
+
+/* Build a Groff command line to format PAGE for display.  */
+char *
+build_formatter_cmd (const Man_page *page)
+{
+  return formatter_cmd (page, groff);
+}
+
+/* Showing one section of a page.
+
+   --section-heading NAME shows only the section of each page headed
+   NAME, like "EXAMPLES" or "SEE ALSO".  The page source is scanned
+   for the .SH or .SS line which starts it, and the formatter is given
+   only the lines up to the next heading of the same or a higher
+   level, after the preamble before the first heading, where the
+   title and the page's own macros are set up.  Definitions made in
+   the sections skipped are kept too.  Formatted pages are sliced at
+   their unindented heading lines.  */
+
+/* Put the text of a heading, from START to END, into BUF of SIZE
+   characters: without quotes, font changes and other escapes, with
+   blanks squeezed.  */
+void
+heading_text (const char *start, const char *end, char *buf, size_t size)
+{
+  const char *s = start;
+  size_t n = 0;
+  int blank = 0;
+
+  while (s < end && n + 1 < size)
+    {
+      int c = (unsigned char)*s++;
+
+      if (c == '\\' && s < end)
+	{
+	  c = (unsigned char)*s++;
+	  if (c == 'f' && s < end)
+	    {
+	      /* \fB, \f(BI or \f[BI]  */
+	      if (*s == '(')
+		s += 3;
+	      else if (*s == '[')
+		while (s < end && *s++ != ']')
+		  ;
+	      else
+		s++;
+	      continue;
+	    }
+	  else if (c == '(')
+	    {
+	      s += 2;
+	      continue;
+	    }
+	  else if (c == '&')
+	    continue;
+	  else if (c == ' ' || c == '~')
+	    c = ' ';
+	}
+      else if (c == '"')
+	continue;
+      else if (c == '\b')
+	{
+	  /* An overstrike: drop the character struck over.  */
+	  if (n > 0)
+	    n--;
+	  continue;
+	}
+
+      if (isspace (c))
+	blank = 1;
+      else
+	{
+	  if (blank && n > 0)
+	    buf[n++] = ' ';
+	  blank = 0;
+	  if (n + 1 < size)
+	    buf[n++] = c;
+	}
+    }
+  buf[n] = '\0';
+}
+
+/* The level of the heading on the roff line LINE, ending at END: 1
+   for .SH, 2 for .SS (or the mdoc .Sh and .Ss), 0 for other lines.
+   *TEXT is set to where the heading text starts.  */
+int
+roff_heading (const char *line, const char *end, const char **text)
+{
+  const char *s = line;
+
+  if (s >= end || (*s != '.' && *s != '\''))
+    return 0;
+  for (s++; s < end && (*s == ' ' || *s == '\t'); s++)
+    ;
+  if (end - s < 2 || s[0] != 'S' || (s[1] != 'H' && s[1] != 'h'
+				      && s[1] != 'S' && s[1] != 's'))
+    return 0;
+  if (s + 2 < end && !isspace ((unsigned char)s[2]))
+    return 0;
+  *text = s + 2;
+  return s[1] == 'H' || s[1] == 'h' ? 1 : 2;
+}
+
+/* Non-zero if the roff line LINE defines a macro, string, register
+   or the like, which the rest of the page may use.  If the definition
+   goes on until a ".." line, *BLOCK is set.  */
+int
+roff_definition (const char *line, const char *end, int *block)
+{
+  static const char *const requests[] = {
+    "de", "de1", "am", "am1", "ds", "ds1", "as", "nr", "rn", "char", "tr"
+  };
+  const char *s = line + 1, *name;
+  size_t len;
+  int i;
+
+  if (line >= end || (*line != '.' && *line != '\''))
+    return 0;
+  while (s < end && (*s == ' ' || *s == '\t'))
+    s++;
+  for (name = s; s < end && isalnum ((unsigned char)*s); s++)
+    ;
+  len = s - name;
+  for (i = 0; i < (int)(sizeof requests / sizeof requests[0]); i++)
+    if (strlen (requests[i]) == len && strncmp (name, requests[i], len) == 0)
+      {
+	*block = (strncmp (name, "de", 2) == 0 || strncmp (name, "am", 2) == 0);
+	return 1;
+      }
+  return 0;
+}
+
+/* Copy the preamble and the section headed HEADING from the roff
+   source TEXT of SIZE bytes to OUT; or with FORMATTED set, from the
+   formatted page TEXT.  Returns non-zero if the section was found.  */
+int
+slice_page (const char *text, size_t size, const char *heading,
+	    int formatted, FILE *out)
+{
+  const char *p = text, *end = text + size;
+  char want[128], have[128];
+  int in_preamble = 1, in_slice = 0, in_definition = 0;
+  int slice_level = 0, found = 0;
+
+  heading_text (heading, heading + strlen (heading), want, sizeof want);
+  fnmatch_fold_key (want, want);
+  while (p < end)
+    {
+      const char *line = p, *eol = (const char *)memchr (p, '\n', end - p);
+      const char *next = eol ? eol + 1 : end, *htext, *c;
+      int level = 0, block = 0, copy;
+
+      have[0] = '\0';
+      if (formatted)
+	{
+	  /* Formatted headings start at the margin and are in capitals,
+	     unlike the title line and the running headers and footers,
+	     which also name the page, like "LS(1)".  */
+	  if (line > text && !isspace ((unsigned char)*line))
+	    {
+	      heading_text (line, next, have, sizeof have);
+	      for (c = have; *c && !islower ((unsigned char)*c); c++)
+		;
+	      level = *c == '\0' && !strchr (have, '(');
+	    }
+	}
+      else if (!in_definition
+	       && (level = roff_heading (line, next, &htext)) > 0)
+	{
+	  /* ".SH" alone takes its heading from the next line.  */
+	  heading_text (htext, next, have, sizeof have);
+	  if (!have[0] && next < end)
+	    {
+	      const char *after = (const char *)memchr (next, '\n', end - next);
+
+	      heading_text (next, after ? after : end, have, sizeof have);
+	    }
+	}
+
+      if (level > 0)
+	{
+	  if (in_slice && level <= slice_level)
+	    break;
+	  in_preamble = 0;
+	  if (!in_slice && strcmp (fnmatch_fold_key (have, have), want) == 0)
+	    {
+	      in_slice = found = 1;
+	      slice_level = level;
+	    }
+	}
+
+      /* Definitions are kept wherever they are.  */
+      copy = in_preamble || in_slice;
+      if (in_definition)
+	{
+	  copy = 1;
+	  if (next - line >= 2 && line[0] == '.' && line[1] == '.')
+	    in_definition = 0;
+	}
+      else if (!formatted && level == 0
+	       && roff_definition (line, next, &block))
+	{
+	  copy = 1;
+	  in_definition = block;
+	}
+      if (copy)
+	fwrite (line, 1, next - line, out);
+      p = next;
+    }
+  return found;
+}
+
+/* The heading of the section --section-heading shows, or NULL.  */
+static const char *section_heading;
+
+/* Display the section of PAGE headed SECTION_HEADING, formatting it
+   with FORMATTER unless that is NULL.  Returns the status of the
+   display, or 2 if the page has no such section.  */
+int
+display_section (const Man_page *page, const char *formatter)
+{
+  Mapped_file mf;
+  Man_page target;
+  char temp[FILENAME_MAX], so_name[FILENAME_MAX];
+  const char *file = page->path;
+  FILE *out;
+  int found, status, hops;
+
+  /* The slice must come from the page itself, not from a stub which
+     sources it; .so is resolved relative to the current directory,
+     the root of the page's subtree.  */
+  target = *page;
+  for (hops = 0; ; hops++)
+    {
+      char line[FILENAME_MAX];
+      size_t len;
+
+      if (map_file (file, &mf))
+	{
+	  fprintf (stderr, "%s: cannot read %s: %s\n", progname, file,
+		   strerror (errno));
+	  return -1;
+	}
+      len = mf.size < sizeof line - 1 ? mf.size : sizeof line - 1;
+      memcpy (line, mf.data, len);
+      line[len] = '\0';
+      if (hops >= 4 || sscanf (line, ".so %s", so_name) != 1)
+	break;
+      unmap_file (&mf);
+      file = so_name;
+      target.flags = set_flags (file);
+      if (formatter && !(target.flags & FLAG_CANT_OPEN))
+	formatter = formatter_cmd (&target, groff);
+    }
+
+  out = make_temp (temp_dir (), temp, "wb");
+  if (!out)
+    {
+      fprintf (stderr, "%s: cannot create a file in %s: %s\n", progname,
+	       temp_dir (), strerror (errno));
+      unmap_file (&mf);
+      return -1;
+    }
+  found = slice_page ((const char *)mf.data, mf.size, section_heading,
+		      formatter == (char *)0, out);
+  unmap_file (&mf);
+  if (fclose (out))
+    found = 0;
+  if (!found)
+    {
+      fprintf (stderr, "%s: no section `%s' in %s\n", progname,
+	       section_heading, page->path);
+      remove (temp);
+      return 2;
+    }
+  if (debugging_output)
+    fprintf (stderr, "Section `%s' of `%s' is in `%s'\n", section_heading,
+	     file, temp);
+  status = display_page (temp, formatter);
+  remove (temp);
+  return status;
+}
+
+/* Running the jobs.  On DOS there is no way to run a program without
+   waiting for it, so the jobs run one at a time.  */
+
+#if defined (__WIN32__)
+typedef HANDLE Job_id;
+#elif !defined (MSDOS)
+typedef pid_t Job_id;
+#else
+typedef int Job_id;	/* the exit status of the finished job */
+#endif
+
+/* The number of processors, or 1 if we cannot tell.  */
+int
+default_jobs (void)
+{
+#if defined (__WIN32__)
+  SYSTEM_INFO si;
+
+  GetSystemInfo (&si);
+  return si.dwNumberOfProcessors;
+#elif defined (_SC_NPROCESSORS_ONLN)
+  long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+  return n > 0 ? (int)n : 1;
+#else
+  return 1;
+#endif
+}
+
+/* Start CMD in the current directory.  Returns non-zero if it could
+   not be started.  */
+int
+start_job (const char *cmd, Job_id *job)
+{
+#if defined (__WIN32__)
+  const char *shell = getenv ("COMSPEC");
+  intptr_t h;
+
+  if (!shell)
+    shell = "cmd.exe";
+  h = _spawnlp (_P_NOWAIT, shell, shell, "/c", cmd, (char *)0);
+  *job = (HANDLE)h;
+  return h == -1;
+#elif !defined (MSDOS)
+  if ((*job = fork ()) == 0)
+    {
+      execl ("/bin/sh", "sh", "-c", cmd, (char *)0);
+      _exit (127);
+    }
+  return *job < 0;
+#else
+  *job = system (cmd);
+  return 0;
+#endif
+}
+
+/* Wait for one of the NJOBS jobs in JOBS to finish, and return its
+   place in JOBS.  Store non-zero in *FAILED if it failed.  */
+int
+wait_job (Job_id *jobs, int njobs, int *failed)
+{
+#if defined (__WIN32__)
+  DWORD i = WaitForMultipleObjects (njobs, jobs, FALSE, INFINITE) - WAIT_OBJECT_0;
+  DWORD code = 1;
+
+  if (i >= (DWORD)njobs)
+    {
+      fprintf (stderr, "%s: waiting for jobs failed\n", progname);
+      exit (3);
+    }
+  GetExitCodeProcess (jobs[i], &code);
+  CloseHandle (jobs[i]);
+  *failed = code != 0;
+  return i;
+#elif !defined (MSDOS)
+  int status, i;
+  pid_t pid;
+
+  for (;;)
+    {
+      if ((pid = wait (&status)) < 0)
+	{
+	  fprintf (stderr, "%s: waiting for jobs failed: %s\n",
+		   progname, strerror (errno));
+	  exit (3);
+	}
+      for (i = 0; i < njobs; i++)
+	if (jobs[i] == pid)
+	  {
+	    *failed = !WIFEXITED (status) || WEXITSTATUS (status) != 0;
+	    return i;
+	  }
+    }
+#else
+  *failed = jobs[njobs - 1] != 0;
+  return njobs - 1;
+#endif
+}
+
+/* Wait up to MS milliseconds for JOB to finish, or for as long as it
+   takes if MS is negative.  Returns non-zero if it finished, and then
+   stores non-zero in *FAILED if it failed.  */
+int
+poll_job (Job_id job, long ms, int *failed)
+{
+#if defined (__WIN32__)
+  DWORD code = 1;
+
+  if (WaitForSingleObject (job, ms < 0 ? INFINITE : (DWORD)ms)
+      != WAIT_OBJECT_0)
+    return 0;
+  GetExitCodeProcess (job, &code);
+  CloseHandle (job);
+  *failed = code != 0;
+  return 1;
+#elif !defined (MSDOS)
+  struct timeval tv;
+  int status;
+  pid_t pid;
+
+  while ((pid = waitpid (job, &status, ms < 0 ? 0 : WNOHANG)) < 0
+	 && errno == EINTR)
+    ;
+  if (pid == 0)
+    {
+      tv.tv_sec = ms / 1000;
+      tv.tv_usec = (ms % 1000) * 1000;
+      select (0, NULL, NULL, NULL, &tv);
+      pid = waitpid (job, &status, WNOHANG);
+      if (pid == 0)
+	return 0;
+    }
+  *failed = pid < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0;
+  return 1;
+#else
+  *failed = job != 0;
+  return 1;
+#endif
+}
+
+/* Showing a page on a budget.
+
+   With --budget MS, man waits no more than MS milliseconds for the
+   formatter to start writing the page.  The formatter runs in the
+   background and writes into the render cache: a file in the private
+   directory named after a hash of the page's path and the formatter
+   command.  Nobody else can write there, so what is in the cache was
+   made by this user's formatter.  An entry of the cache which is newer
+   than the page is shown at once, without running the formatter;
+   --speculate fills the cache ahead, and looks in it even without a
+   budget.  If no output has come when the budget runs out, the page is
+   shown from its pre-formatted catN copy, or from an old entry of the
+   cache, or else as plain text made from the source on the spot, and
+   the formatter goes on to fill the cache for the next time.  DOS
+   cannot run the formatter in the background; there, the budget is
+   ignored.  */
+
+/* How long to wait for the formatter to start, or 0 not to limit it.  */
+static long render_budget;
+
+/* How many pages to render ahead with --speculate; see below.  */
+static int speculate_pages;
+
+/* Put the name of the render cache entry for FILE formatted with
+   FORMATTER into NAME.  Returns non-zero if there is no render
+   cache.  */
+int
+render_cache_name (const char *file, const char *formatter, char *name)
+{
+  char cwd[FILENAME_MAX];
+  const char *parts[3], *p;
+  const char *private = private_dir ();
+  unsigned long h1 = 0, h2 = 2166136261UL;
+  int i;
+
+  if (!private)
+    return -1;
+  /* The same relative name in another directory is another page.  */
+  parts[0] = "";
+  if (!IS_DIR_SEP (file[0]) && !(file[0] && file[1] == ':')
+      && getcwd (cwd, sizeof cwd))
+    parts[0] = cwd;
+  parts[1] = file;
+  parts[2] = formatter;
+  for (i = 0; i < 3; i++)
+    for (p = parts[i]; ; p++)
+      {
+	h1 = (h1 * 31 + (unsigned char)*p) & 0xffffffffUL;
+	h2 = ((h2 ^ (unsigned char)*p) * 16777619UL) & 0xffffffffUL;
+	if (!*p)
+	  break;
+      }
+  sprintf (name, "%s/man%08lx%08lx.txt", private, h1, h2);
+  return 0;
+}
+
+/* Non-zero if the rendering in NAME is there and not empty, and, if
+   FILE is not null, newer than the page FILE; one written in the same
+   second as the page might be from before it changed.  */
+int
+usable_render (const char *name, const char *file)
+{
+  struct stat st, page_st;
+
+  if (stat (name, &st) || st.st_size == 0)
+    return 0;
+  return !file
+	 || (stat (file, &page_st) == 0 && st.st_mtime > page_st.st_mtime);
+}
+
+/* Put into COPY the name of the page in the catN directory next to
+   the manN directory which holds FILE.  Returns non-zero if there is
+   such a page.  */
+int
+cat_copy (const char *file, char *copy)
+{
+  const char *base = file + strlen (file);
+  struct stat st;
+
+  while (base > file && !IS_DIR_SEP (base[-1]))
+    base--;
+  /* ".../man1/foo.1"  */
+  if (base - file < 5 || strncmp (base - 5, "man", 3) != 0
+      || !strchr (section_letters, base[-2])
+      || (base - file > 5 && !IS_DIR_SEP (base[-6])))
+    return 0;
+  strcpy (copy, file);
+  memcpy (copy + (base - 5 - file), "cat", 3);
+  return stat (copy, &st) == 0 && st.st_size > 0;
+}
+
+/* The plain text made from the page source when the formatter is too
+   slow.  Only the headings, paragraphs, tags and font macros among
+   the requests are heeded, the escapes become the characters they
+   stand for, and the text is filled to PLAIN_WIDTH columns.  */
+
+#define PLAIN_WIDTH	78
+#define PLAIN_INDENT	7
+
+typedef struct {
+  FILE *out;
+  char line[PLAIN_WIDTH + 1];
+  int len;
+  int indent;		/* of the line being filled */
+  int next_indent;	/* if non-zero, the indent after this line */
+  int fill;		/* zero between .nf and .fi */
+  int blank;		/* the last line written was blank */
+} Plain_text;
+
+/* Write out the line PT is filling.  */
+void
+plain_flush (Plain_text *pt)
+{
+  if (pt->len > 0)
+    {
+      fprintf (pt->out, "%*s%.*s\n", pt->indent, "", pt->len, pt->line);
+      pt->len = 0;
+      pt->blank = 0;
+    }
+}
+
+/* End the paragraph PT is filling with a blank line.  */
+void
+plain_break (Plain_text *pt)
+{
+  plain_flush (pt);
+  if (!pt->blank)
+    putc ('\n', pt->out);
+  pt->blank = 1;
+}
+
+/* Add the N bytes of TEXT to PT a word at a time, or as a line of its
+   own if PT is not filling.  */
+void
+plain_words (Plain_text *pt, const char *text, size_t n)
+{
+  const char *s = text, *end = text + n;
+
+  if (!pt->fill)
+    {
+      plain_flush (pt);
+      fprintf (pt->out, "%*s%.*s\n", n ? pt->indent : 0, "", (int)n, text);
+      pt->blank = n == 0;
+      return;
+    }
+  for (;;)
+    {
+      const char *word;
+      size_t len;
+
+      while (s < end && isspace ((unsigned char)*s))
+	s++;
+      for (word = s; s < end && !isspace ((unsigned char)*s); s++)
+	;
+      if ((len = s - word) == 0)
+	break;
+      if (pt->len > 0 && pt->indent + pt->len + 1 + len > PLAIN_WIDTH)
+	plain_flush (pt);
+      if (pt->indent + len > PLAIN_WIDTH)
+	{
+	  fprintf (pt->out, "%*s%.*s\n", pt->indent, "", (int)len, word);
+	  pt->blank = 0;
+	  continue;
+	}
+      if (pt->len > 0)
+	pt->line[pt->len++] = ' ';
+      memcpy (pt->line + pt->len, word, len);
+      pt->len += len;
+    }
+}
+
+/* The special characters \(xx which have a plain stand-in.  */
+static const char *const plain_chars[] = {
+  "em", "--", "en", "-", "hy", "-", "mi", "-", "bu", "o", "lq", "\"",
+  "rq", "\"", "dq", "\"", "oq", "'", "cq", "'", "aq", "'", "ga", "`",
+  "co", "(C)", "rg", "(R)", "tm", "(TM)", "mu", "x", "<=", "<=",
+  ">=", ">=", "->", "->", "<-", "<-", "ti", "~", "ha", "^", "rs", "\\",
+  "ba", "|", "br", "|", "pl", "+", "eq", "="
+};
+
+/* Skip the name of a font, string, register or the like at S, after
+   \f, \* and their kind: one character, two after `(', or up to `]'
+   after `['.  */
+const char *
+skip_escape_name (const char *s, const char *end)
+{
+  if (s < end && *s == '(')
+    s += 3;
+  else if (s < end && *s == '[')
+    {
+      while (s < end && *s != ']')
+	s++;
+      s++;
+    }
+  else
+    s++;
+  return s < end ? s : end;
+}
+
+/* Put the roff text from S to END into BUF of SIZE characters, with
+   the escapes turned into the characters they stand for, and the
+   comments, font changes and motions dropped.  Returns the length.  */
+size_t
+plain_unescape (const char *s, const char *end, char *buf, size_t size)
+{
+  size_t n = 0;
+
+  while (s < end)
+    {
+      const char *text = (char *)0;
+      int c = (unsigned char)*s++;
+
+      if (c == '\\' && s >= end)	/* the line goes on */
+	break;
+      if (c == '\\')
+	{
+	  c = (unsigned char)*s++;
+	  switch (c)
+	    {
+	      case '"':		/* a comment */
+	      case '#':
+		s = end;
+		continue;
+	      case 'f':		/* \fB \f(CW \f[CW] */
+	      case 'F':
+	      case '*':		/* \*x \*(xx \*[name] */
+	      case 'n':		/* \nx \n+(xx */
+	      case 'g':
+	      case 'm':
+	      case 'M':
+	      case 'V':
+	      case 'Y':
+		if (c == 'n' && s < end && (*s == '+' || *s == '-'))
+		  s++;
+		s = skip_escape_name (s, end);
+		continue;
+	      case 's':		/* \s-1 \s0 \s(12 */
+		if (s < end && (*s == '+' || *s == '-'))
+		  s++;
+		if (s < end && (*s == '(' || *s == '['))
+		  s = skip_escape_name (s, end);
+		else
+		  while (s < end && isdigit ((unsigned char)*s))
+		    s++;
+		continue;
+	      case '(':		/* \(em \[em] */
+	      case '[':
+		{
+		  const char *name = s, *name_end;
+		  size_t i;
+
+		  if (c == '(')
+		    s = name_end = name + 2 < end ? name + 2 : end;
+		  else
+		    {
+		      s = skip_escape_name (s - 1, end);
+		      name_end = s > name ? s - 1 : s;
+		    }
+		  for (i = 0; i < sizeof plain_chars / sizeof plain_chars[0];
+		       i += 2)
+		    if (name_end - name == 2
+			&& strncmp (name, plain_chars[i], 2) == 0)
+		      text = plain_chars[i + 1];
+		  if (!text)
+		    continue;
+		}
+		break;
+	      case 'h':		/* motions, lines and the like: \h'1i' */
+	      case 'v':
+	      case 'w':
+	      case 'l':
+	      case 'L':
+	      case 'D':
+	      case 'o':
+	      case 'b':
+	      case 'x':
+	      case 'X':
+	      case 'Z':
+	      case 'A':
+	      case 'B':
+	      case 'C':
+	      case 'N':
+	      case 'R':
+	      case 'S':
+	      case 'H':
+		if (s < end)
+		  {
+		    int delim = *s++;
+
+		    while (s < end && *s != delim)
+		      s++;
+		    if (s < end)
+		      s++;
+		  }
+		continue;
+	      case 'k':
+	      case 'z':
+		if (s < end)
+		  s++;
+		continue;
+	      case '&':		/* zero-width things */
+	      case '|':
+	      case '^':
+	      case ':':
+	      case '%':
+	      case '/':
+	      case ',':
+	      case ')':
+	      case '{':
+	      case '}':
+	      case 'c':
+	      case 'a':
+	      case 'd':
+	      case 'p':
+	      case 'r':
+	      case 'u':
+	      case 'E':
+	      case '\n':
+		continue;
+	      case 'e':
+		c = '\\';
+		break;
+	      case ' ':
+	      case '~':
+	      case '0':
+	      case 't':
+		c = ' ';
+		break;
+	      default:		/* \- \. \' \\ and the like */
+		break;
+	    }
+	}
+      if (!text)
+	{
+	  if (n + 1 < size)
+	    buf[n++] = c;
+	}
+      else
+	while (*text && n + 1 < size)
+	  buf[n++] = *text++;
+    }
+  return n;
+}
+
+/* Put at most MAX (or all, if MAX is 0) of the arguments of the
+   request from S to END into BUF of SIZE characters, without their
+   quotes and with the escapes turned as plain_unescape does, separated
+   by blanks, or run together if JOIN is non-zero.  Returns the
+   length.  */
+size_t
+plain_args (const char *s, const char *end, char *buf, size_t size,
+	    int join, int max)
+{
+  size_t n = 0;
+  int nargs = 0;
+
+  while (max == 0 || nargs < max)
+    {
+      const char *arg;
+
+      while (s < end && (*s == ' ' || *s == '\t'))
+	s++;
+      if (s >= end || (*s == '\\' && s + 1 < end && s[1] == '"'))
+	break;
+      if (*s == '"')
+	for (arg = ++s; s < end && *s != '"'; s++)
+	  ;
+      else
+	for (arg = s; s < end && *s != ' ' && *s != '\t'; s++)
+	  if (*s == '\\' && s + 1 < end)
+	    s++;
+      if (nargs++ > 0 && !join && n + 1 < size)
+	buf[n++] = ' ';
+      n += plain_unescape (arg, s, buf + n, size - n);
+      if (s < end)
+	s++;		/* past the closing quote or the blank */
+    }
+  return n;
+}
+
+/* Write the plain text made from the page source TEXT of LEN bytes to
+   OUT.  */
+void
+plain_page (const char *text, size_t len, FILE *out)
+{
+  Plain_text pt;
+  char buf[BUFSIZ];
+  const char *s = text, *end = text + len;
+
+  pt.out = out;
+  pt.len = 0;
+  pt.indent = PLAIN_INDENT;
+  pt.next_indent = 0;
+  pt.fill = 1;
+  pt.blank = 1;
+  while (s < end)
+    {
+      const char *eol = (const char *)memchr (s, '\n', end - s);
+      const char *heading;
+      int level, wrote = 0;
+
+      if (!eol)
+	eol = end;
+      if ((level = roff_heading (s, eol, &heading)) != 0)
+	{
+	  plain_break (&pt);
+	  pt.indent = level == 1 ? 0 : PLAIN_INDENT / 2;
+	  heading_text (heading, eol, buf, sizeof buf);
+	  plain_words (&pt, buf, strlen (buf));
+	  if (pt.len > 0)
+	    wrote = 1;
+	  pt.next_indent = PLAIN_INDENT;
+	}
+      else if (*s == '.' || *s == '\'')
+	{
+	  const char *name = s + 1, *args;
+	  char req[4];
+
+	  while (name < eol && (*name == ' ' || *name == '\t'))
+	    name++;
+	  for (args = name; args < eol && !isspace ((unsigned char)*args);
+	       args++)
+	    ;
+	  req[0] = '\0';
+	  if (args - name < (int)sizeof req)
+	    {
+	      memcpy (req, name, args - name);
+	      req[args - name] = '\0';
+	    }
+	  if (strcmp (req, "PP") == 0 || strcmp (req, "LP") == 0
+	      || strcmp (req, "P") == 0 || strcmp (req, "Pp") == 0
+	      || strcmp (req, "sp") == 0)
+	    {
+	      plain_break (&pt);
+	      pt.indent = PLAIN_INDENT;
+	    }
+	  else if (strcmp (req, "br") == 0)
+	    plain_flush (&pt);
+	  else if (strcmp (req, "TP") == 0 || strcmp (req, "IP") == 0)
+	    {
+	      size_t n = plain_args (args, eol, buf, sizeof buf, 0, 1);
+
+	      plain_break (&pt);
+	      pt.indent = PLAIN_INDENT;
+	      pt.next_indent = 2 * PLAIN_INDENT;
+	      if (req[0] == 'I')
+		{
+		  plain_words (&pt, buf, n);
+		  wrote = 1;
+		}
+	    }
+	  else if (strcmp (req, "nf") == 0 || strcmp (req, "EX") == 0)
+	    {
+	      plain_flush (&pt);
+	      pt.fill = 0;
+	    }
+	  else if (strcmp (req, "fi") == 0 || strcmp (req, "EE") == 0)
+	    pt.fill = 1;
+	  else if (strcmp (req, "B") == 0 || strcmp (req, "I") == 0
+		   || strcmp (req, "SM") == 0 || strcmp (req, "SB") == 0)
+	    {
+	      plain_words (&pt, buf, plain_args (args, eol, buf, sizeof buf,
+						 0, 0));
+	      wrote = 1;
+	    }
+	  else if (strlen (req) == 2 && strchr ("BIR", req[0])
+		   && strchr ("BIR", req[1]) && req[0] != req[1])
+	    {
+	      plain_words (&pt, buf, plain_args (args, eol, buf, sizeof buf,
+						 1, 0));
+	      wrote = 1;
+	    }
+	}
+      else if (s == eol && pt.fill)
+	plain_break (&pt);
+      else
+	{
+	  plain_words (&pt, buf, plain_unescape (s, eol, buf, sizeof buf));
+	  wrote = 1;
+	}
+      /* The tag of a .TP or .IP paragraph, or the heading, goes on a
+	 line of its own.  */
+      if (wrote && pt.next_indent)
+	{
+	  plain_flush (&pt);
+	  pt.indent = pt.next_indent;
+	  pt.next_indent = 0;
+	}
+      s = eol + 1;
+    }
+  plain_flush (&pt);
+}
+
+/* Map the page FILE into MF, or the page it sources if it is a .so
+   stub, following the .so requests as display_section does.  Returns
+   zero on success.  */
+int
+map_page_source (const char *file, Mapped_file *mf)
+{
+  char line[FILENAME_MAX], so_name[FILENAME_MAX];
+  size_t len;
+  int hops;
+
+  for (hops = 0; ; hops++)
+    {
+      if (map_file (file, mf))
+	return -1;
+      len = mf->size < sizeof line - 1 ? mf->size : sizeof line - 1;
+      memcpy (line, mf->data, len);
+      line[len] = '\0';
+      if (hops >= 4 || sscanf (line, ".so %s", so_name) != 1)
+	return 0;
+      unmap_file (mf);
+      file = so_name;
+    }
+}
+
+/* Write the plain text made from the page FILE to OUT_NAME.  Returns
+   non-zero if that could not be done.  */
+int
+plain_render (const char *file, const char *out_name)
+{
+  Mapped_file mf;
+  FILE *out;
+
+  if (map_page_source (file, &mf))
+    return -1;
+  out = fopen (out_name, "w");
+  if (!out)
+    {
+      unmap_file (&mf);
+      return -1;
+    }
+  plain_page ((const char *)mf.data, mf.size, out);
+  unmap_file (&mf);
+  return fclose (out) ? -1 : 0;
+}
+
+#if !defined (MSDOS)
+
+/* Display FILE formatted with FORMATTER, from the render cache if it
+   is there, or else something in its place if the formatter does not
+   start writing within RENDER_BUDGET milliseconds.  */
+int
+budget_display (const char *file, const char *formatter)
+{
+  char cache[FILENAME_MAX], temp[FILENAME_MAX], shown[FILENAME_MAX];
+  char *cmd;
+  unsigned long start = now_ms ();
+  Job_id job;
+  struct stat st;
+  FILE *fp;
+  int failed, status;
+
+  if (render_cache_name (file, formatter, cache))
+    return display_page (file, formatter);
+  if (usable_render (cache, file))
+    {
+      if (verbose_option)
+	fprintf (stderr, "%s: %s: showing the rendering cached in %s\n",
+		 progname, file, cache);
+      return display_page (cache, (char *)0);
+    }
+  if (render_budget <= 0)
+    return display_page (file, formatter);
+
+  /* "groff -man -Tascii /usr/man/man1/foo.1 > /tmp/man-0/manAbc123;
+      mv -f /tmp/man-0/manAbc123 /tmp/man-0/man0123456789abcdef.txt"
+     The formatter may outlive us, so each one gets a file of its own,
+     made here so that the shell only writes over it.  */
+  if ((fp = make_temp (private_dir (), temp, "w")) == 0)
+    return display_page (file, formatter);
+  fclose (fp);
+  cmd = (char *)alloca (strlen (formatter) + strlen (file)
+			+ 2 * strlen (temp) + strlen (cache) + 40);
+  sprintf (cmd, "%s \"%s\" > \"%s\" %s %s \"%s\" \"%s\" > %s", formatter,
+	   file, temp, JOB_THEN, MOVE_CMD, temp, cache, NULL_DEVICE);
+  if (debugging_output)
+    fprintf (stderr, "Running `%s'\n", cmd);
+  fflush (stdout);
+  fflush (stderr);
+  if (start_job (cmd, &job))
+    {
+      remove (temp);
+      return display_page (file, formatter);
+    }
+
+  while (!poll_job (job, 10, &failed))
+    {
+      if (stat (temp, &st) == 0 && st.st_size > 0)
+	{
+	  /* The output has started: wait for the rest of it.  */
+	  poll_job (job, -1, &failed);
+	  break;
+	}
+      if ((long)(now_ms () - start) < render_budget)
+	continue;
+
+      /* Out of time: show what there is instead.  */
+      if (cat_copy (file, shown))
+	{
+	  if (verbose_option)
+	    fprintf (stderr, "%s: %s: not formatted within %ld ms, "
+		     "showing %s\n", progname, file, render_budget, shown);
+	  return display_page (shown, (char *)0);
+	}
+      if (usable_render (cache, (char *)0))
+	{
+	  if (verbose_option)
+	    fprintf (stderr, "%s: %s: not formatted within %ld ms, "
+		     "showing the old rendering in %s\n", progname, file,
+		     render_budget, cache);
+	  return display_page (cache, (char *)0);
+	}
+      if ((fp = make_temp (private_dir (), shown, "w")) != 0)
+	{
+	  fclose (fp);
+	  if (plain_render (file, shown) == 0)
+	    {
+	      if (verbose_option)
+		fprintf (stderr, "%s: %s: not formatted within %ld ms, "
+			 "showing it as plain text\n", progname, file,
+			 render_budget);
+	      status = display_page (shown, (char *)0);
+	      remove (shown);
+	      return status;
+	    }
+	  remove (shown);
+	}
+      /* Nothing else to show: wait for the formatter after all.  */
+      poll_job (job, -1, &failed);
+      break;
+    }
+
+  if (verbose_option)
+    fprintf (stderr, "%s: %s: formatted in %lu ms\n", progname, file,
+	     now_ms () - start);
+  if (failed && verbose_option)
+    fprintf (stderr, "%s: `%s' returned non-zero\n", progname, cmd);
+  if (usable_render (cache, (char *)0))
+    return display_page (cache, (char *)0);
+  status = display_page (temp, (char *)0);
+  remove (temp);
+  return status;
+}
+
+#endif /* not MSDOS */
+
+/* Display PAGE, or the section of it --section-heading asks for.  */
+int
+show_page (const Man_page *page, const char *formatter)
+{
+  if (section_heading)
+    return display_section (page, formatter);
+#if !defined (MSDOS)
+  if ((render_budget > 0 || speculate_pages > 0) && formatter)
+    return budget_display (page->path, formatter);
+#endif
+  return display_page (page->path, formatter);
+}
+
+/* The output buffer in --batch mode.  */
+#define BATCH_BUFSIZ	16384
+
+int find_alias (const char *section, const char *name);
+
+/* Resolve the topics named by lines read from the standard input, one
+   per line, as "topic", "section topic" or "topic(section)".  Write a
+   record "section<TAB>topic<TAB>path" for each, with the path which
+   -U would show, or an empty path if there is no such page.  SECTION
+   is used for topics given without one.  */
+int
+batch_lookup (const char *section)
+{
+  char line[FILENAME_MAX], sect[FILENAME_MAX], topic[FILENAME_MAX];
+  int status = 0;
+
+  use_snapshot = 1;
+  while (fgets (line, sizeof line, stdin))
+    {
+      int count, fields = sscanf (line, "%s %s", sect, topic);
+      char *p;
+
+      if (fields <= 0)
+	continue;
+      if (fields == 1)
+	{
+	  strcpy (topic, sect);
+	  strcpy (sect, section);
+	  p = strchr (topic, '(');
+	  if (p && p > topic && p[1] && p[strlen (p) - 1] == ')')
+	    {
+	      *p++ = '\0';
+	      p[strlen (p) - 1] = '\0';
+	      strcpy (sect, p);
+	    }
+	}
+
+      page_mode = KEEP_FIRST;
+      count = find_pages (sect, topic);
+      if (count == 0 && !strpbrk (topic, "*?["))
+	count = find_alias (sect, topic);
       if (count > 1)
+	sort_pages ();
+      printf ("%s\t%s\t%s\n", sect, topic,
+	      count > 0 ? pages[next_slot - 1]->path : "");
+      if (count <= 0)
+	status = 2;
+      while (next_slot > 0)
+	remove_page (next_slot - 1);
+    }
+  use_snapshot = 0;
+  if (fflush (stdout))
+    {
+      fprintf (stderr, "%s: cannot write the results: %s\n",
+	       progname, strerror (errno));
+      status |= 1;
+    }
+  return status;
+}
+
+/* List the pages in SECTION whose topic has a match of the extended
+   regular expression PATTERN, as "section<TAB>topic<TAB>path" lines,
+   as they are found.  */
+int
+regex_lookup (const char *section, const char *pattern)
+{
+  topic_regex = compile_regex (pattern);
+  if (!topic_regex)
+    return 1;
+  regex_found = 0;
+  page_mode = MATCH_REGEX;
+  find_pages (section, "*");
+  if (debugging_output)
+    fprintf (stderr, "%lu topics matched, using %d DFA states\n",
+	     regex_found, topic_regex->ndfa);
+  free_regex (topic_regex);
+  topic_regex = (Regex *)0;
+  return regex_found ? 0 : 2;
+}
+
+/* Exporting pages to HTML.
+
+   --export DIR renders every page the search path has into DIR, as
+   one NAME.html file per page file NAME.  Pages are rendered by groff
+   in up to -j jobs at a time; pre-formatted pages are converted by man
+   itself.  References like "printf(3)" to other exported pages become
+   links, and stubs which just .so another page become links to that
+   page.  A page whose HTML file is newer than the page is not
+   rendered again.  */
+
+#define XREF_BUCKETS	1024
+
+typedef struct {
+  Man_page *page;
+  char *html;		/* the output file, relative to the export dir */
+  size_t namelen;	/* the topic is the first NAMELEN chars of page->name */
+  const char *section;	/* the section suffix in page->name */
+  size_t seclen;
+  int next;		/* the next page in its XREF bucket, or -1 */
+} Export_page;
+
+static Export_page *exports;
+static int nexports;
+static int xref[XREF_BUCKETS];
+
+/* How many pages to render at a time; by default, one per processor.  */
+int export_jobs;
+
+unsigned
+xref_hash (const char *name, size_t len)
+{
+  unsigned hash = 0;
+
+  while (len--)
+    hash = hash * 31 + (unsigned char)*name++;
+  return hash % XREF_BUCKETS;
+}
+
+/* Find the exported page for topic NAME in section SEC, given their
+   lengths.  A page whose section only starts with SEC, like "3x" for
+   "3", will do if there is no exact match.  */
+Export_page *
+find_export (const char *name, size_t namelen, const char *sec, size_t seclen)
+{
+  Export_page *close = (Export_page *)0;
+  int i;
+
+  for (i = xref[xref_hash (name, namelen)]; i >= 0; i = exports[i].next)
+    {
+      Export_page *e = &exports[i];
+
+      if (e->namelen != namelen || strncmp (e->page->name, name, namelen))
+	continue;
+      if (e->seclen == seclen && strncmp (e->section, sec, seclen) == 0)
+	return e;
+      if (!close && e->seclen > seclen && strncmp (e->section, sec, seclen) == 0)
+	close = e;
+    }
+  return close;
+}
+
+/* Non-zero if C may be part of a topic name in a cross-reference.  */
+#define IS_XREF_CHAR(c)	\
+  (isalnum ((unsigned char)(c)) || strchr ("_.:+-", (c)))
+
+/* Write the LEN bytes of HTML at TEXT to FP, turning references to
+   exported pages other than SELF into links.  A reference is a topic
+   followed by a section in parentheses, perhaps with the topic set in
+   bold or italics: "foo(3)", "<b>foo</b>(3)".  */
+void
+write_linked_html (const char *text, size_t len, const Export_page *self,
+		   FILE *fp)
+{
+  const char *end = text + len, *copied = text, *p = text;
+
+  while ((p = memchr (p, '(', end - p)) != 0)
+    {
+      const char *sec = p + 1, *sec_end = sec, *name, *name_end = p;
+      Export_page *e;
+
+      p++;
+      while (sec_end < end && sec_end - sec < 8 && isalnum ((unsigned char)*sec_end))
+	sec_end++;
+      if (sec == sec_end || !isdigit ((unsigned char)*sec)
+	  || sec_end >= end || *sec_end != ')')
+	continue;
+      if (name_end - copied >= 4
+	  && (strncmp (name_end - 4, "</b>", 4) == 0
+	      || strncmp (name_end - 4, "</i>", 4) == 0))
+	name_end -= 4;
+      for (name = name_end; name > copied && IS_XREF_CHAR (name[-1]); name--)
+	;
+      if (name == name_end
+	  || (e = find_export (name, name_end - name,
+			       sec, sec_end - sec)) == 0
+	  || e == self)
+	continue;
+      fwrite (copied, 1, name - copied, fp);
+      fprintf (fp, "<a href=\"%s\">", e->html);
+      fwrite (name, 1, name_end - name, fp);
+      fputs ("</a>", fp);
+      copied = name_end;
+    }
+  fwrite (copied, 1, end - copied, fp);
+}
+
+/* Convert the pre-formatted page TEXT of LEN bytes to HTML, turning
+   overstruck characters into bold and underlined ones into italics.
+   Returns a malloc'ed buffer and stores its size in *SIZE.  */
+char *
+formatted_to_html (const char *text, size_t len, size_t *size)
+{
+  static const char *open_tag[] = { "", "<b>", "<i>" };
+  static const char *close_tag[] = { "", "</b>", "</i>" };
+  const char *end = text + len;
+  size_t alloc = len + len / 4 + 64, used = 0;
+  char *out = (char *)xmalloc (alloc);
+  int style = 0;
+
+#define EMIT(s) \
+  do { size_t l_ = strlen (s); \
+       if (used + l_ > alloc) out = (char *)xrealloc (out, alloc = 2 * alloc + l_); \
+       memcpy (out + used, (s), l_); used += l_; } while (0)
+
+  EMIT ("<html><body><pre>\n");
+  while (text < end)
+    {
+      int c = (unsigned char)*text++, new_style = 0;
+      char ch[2];
+
+      /* "_\bc" is an underlined c, "c\bc" a bold one.  */
+      while (text + 1 < end && *text == '\b')
+	{
+	  new_style = (c == '_' ? 2 : 1);
+	  c = (unsigned char)text[1];
+	  text += 2;
+	}
+      if (new_style != style)
+	{
+	  EMIT (close_tag[style]);
+	  EMIT (open_tag[new_style]);
+	  style = new_style;
+	}
+      ch[0] = c;
+      ch[1] = '\0';
+      EMIT (c == '<' ? "&lt;" : c == '>' ? "&gt;" : c == '&' ? "&amp;" : ch);
+    }
+  EMIT (close_tag[style]);
+  EMIT ("</pre></body></html>\n");
+#undef EMIT
+  *size = used;
+  return out;
+}
+
+/* If PAGE is a stub whose only request is ".so FILE", return the base
+   name of FILE, else null.  */
+char *
+so_target (const Man_page *page)
+{
+  static char target[FILENAME_MAX];
+  char line[FILENAME_MAX];
+  FILE *fp;
+  int stub;
+
+  if (!(page->flags & FLAG_SOELIM) || (fp = fopen (page->path, "rt")) == 0)
+    return (char *)0;
+  stub = (fgets (line, sizeof line, fp) && sscanf (line, ".so %s", target) == 1);
+  while (stub && fgets (line, sizeof line, fp))
+    stub = (line[strspn (line, " \t\r\n")] == '\0');
+  fclose (fp);
+  if (!stub)
+    return (char *)0;
+  return strrchr (target, '/') ? strrchr (target, '/') + 1 : target;
+}
+
+/* The root of the manual subtree which holds PAGE, without the manN or
+   catN subdirectory: groff resolves .so requests relative to it.  */
+void
+page_root (const Man_page *page, char *root)
+{
+  size_t len = page->name - page->path - 1;
+
+  memcpy (root, page->path, len);
+  root[len] = '\0';
+  if ((strncmp (root + len - 5, "/cat", 4) == 0
+       || strncmp (root + len - 5, "/man", 4) == 0)
+      && strchr (section_letters, root[len - 1]))
+    root[len - 5] = '\0';
+}
+
+/* Make the HTML file for the exported page E from its rendering in
+   TEMP, or from the page itself if it is pre-formatted.  */
+int
+finish_export (const char *dir, const Export_page *e, const char *temp)
+{
+  char file[FILENAME_MAX];
+  char *text, *html;
+  size_t size, html_size;
+  FILE *fp;
+  int status = 0;
+
+  text = read_file (temp ? temp : e->page->path, &size);
+  if (!text)
+    {
+      fprintf (stderr, "%s: cannot read %s: %s\n", progname,
+	       temp ? temp : e->page->path, strerror (errno));
+      return 1;
+    }
+  if (temp)
+    {
+      html = text;
+      html_size = size;
+    }
+  else
+    {
+      html = formatted_to_html (text, size, &html_size);
+      free (text);
+    }
+
+  sprintf (file, "%s/%s", dir, e->html);
+  if ((fp = fopen (file, "wb")) == 0)
+    status = 1;
+  else
+    {
+      write_linked_html (html, html_size, e, fp);
+      if (ferror (fp) | fclose (fp))
+	status = 1;
+    }
+  if (status)
+    fprintf (stderr, "%s: cannot write %s: %s\n", progname, file,
+	     strerror (errno));
+  free (html);
+  if (temp)
+    remove (temp);
+  return status;
+}
+
+/* Write the page E, a stub for TARGET, as a link to TARGET's page.  */
+int
+export_stub (const char *dir, const Export_page *e, const char *target)
+{
+  char file[FILENAME_MAX];
+  FILE *fp;
+
+  sprintf (file, "%s/%s", dir, e->html);
+  if ((fp = fopen (file, "wt")) == 0)
+    {
+      fprintf (stderr, "%s: cannot write %s: %s\n", progname, file,
+	       strerror (errno));
+      return 1;
+    }
+  fprintf (fp, "<html><head>"
+	   "<meta http-equiv=\"refresh\" content=\"0; url=%s.html\">"
+	   "</head><body>See <a href=\"%s.html\">%s</a>.</body></html>\n",
+	   target, target, target);
+  return fclose (fp) != 0;
+}
+
+/* Export the pages of section SECTION in the search path into the
+   directory DIR.  */
+int
+export_pages (const char *dir, const char *section)
+{
+  char out_dir[PATH_MAX], curdir[PATH_MAX], root[PATH_MAX];
+  char file[FILENAME_MAX], temp[FILENAME_MAX], cmd[3 * FILENAME_MAX];
+  Job_id *jobs;
+  int *job_page;
+  int njobs = 0, count, i, status = 0, rendered = 0, unchanged = 0;
+  size_t len = 0;
+
+  if (!getcwd (curdir, sizeof curdir))
+    {
+      fprintf (stderr, "%s: cannot get the current directory: %s\n",
+	       progname, strerror (errno));
+      return 1;
+    }
+  /* The jobs run in the roots of the manual subtrees.  */
+  if (!IS_DIR_SEP (dir[0])
+#if defined (MSDOS) || defined (__WIN32__)
+      && dir[1] != ':'
+#endif
+      )
+    len = strlen (curdir) + 1;
+  if (len + strlen (dir) >= sizeof out_dir)
+    {
+      fprintf (stderr, "%s: %s: name too long\n", progname, dir);
+      return 1;
+    }
+  if (len)
+    {
+      memcpy (out_dir, curdir, len - 1);
+      out_dir[len - 1] = '/';
+    }
+  strcpy (out_dir + len, dir);
+  if (!isadir (out_dir))
+    {
+      fprintf (stderr, "%s: %s is not a directory\n", progname, dir);
+      return 1;
+    }
+
+  page_mode = KEEP_ALL;
+  count = find_pages (section, "*");
+  exports = (Export_page *)xmalloc ((count + 1) * sizeof (Export_page));
+  for (i = 0; i < XREF_BUCKETS; i++)
+    xref[i] = -1;
+
+  /* The first page found by each file name wins, as when displaying
+     it.  Compressed pages are left alone.  */
+  for (i = 0; i < next_slot; i++)
+    {
+      Man_page *page = pages[i];
+      Export_page *e = &exports[nexports], *dup;
+      const char *dot = strrchr (page->name, '.');
+      unsigned h;
+
+      if (!dot || dot == page->name
+	  || (page->flags & (FLAG_CANT_OPEN | FLAG_VGRIND))
+	  || not_a_page (page->name))
+	continue;
+      /* Its HTML file, and the temporary file beside it, must fit
+	 their buffers.  */
+      if (strlen (out_dir) + strlen (page->name) + 8 > sizeof file)
+	{
+	  fprintf (stderr, "%s: %s/%s.html: name too long\n", progname,
+		   out_dir, page->name);
+	  status = 1;
+	  continue;
+	}
+      e->page = page;
+      e->namelen = dot - page->name;
+      e->section = dot + 1;
+      e->seclen = strlen (dot + 1);
+      dup = find_export (page->name, e->namelen, e->section, e->seclen);
+      if (dup && dup->seclen == e->seclen)
+	continue;
+      e->html = (char *)xmalloc (strlen (page->name) + 6);
+      strcat (strcpy (e->html, page->name), ".html");
+      h = xref_hash (page->name, e->namelen);
+      e->next = xref[h];
+      xref[h] = nexports++;
+    }
+
+  if (export_jobs < 1)
+    export_jobs = default_jobs ();
+  jobs = (Job_id *)xmalloc (export_jobs * sizeof (Job_id));
+  job_page = (int *)xmalloc (export_jobs * sizeof (int));
+
+  for (i = 0; i < nexports || njobs > 0; )
+    {
+      Export_page *e;
+      struct stat src_st, html_st;
+      char *target;
+
+      /* Reap a job when all are busy or there is nothing left to start.  */
+      if (njobs == export_jobs || i >= nexports)
+	{
+	  int failed, j = wait_job (jobs, njobs, &failed);
+
+	  e = &exports[job_page[j]];
+	  sprintf (temp, "%s/%s~", out_dir, e->html);
+	  if (failed)
+	    {
+	      fprintf (stderr, "%s: cannot render %s\n", progname,
+		       e->page->path);
+	      remove (temp);
+	      status = 1;
+	    }
+	  else
+	    status |= finish_export (out_dir, e, temp);
+	  jobs[j] = jobs[--njobs];
+	  job_page[j] = job_page[njobs];
+	  continue;
+	}
+
+      e = &exports[i++];
+      sprintf (file, "%s/%s", out_dir, e->html);
+      if (stat (e->page->path, &src_st) == 0 && stat (file, &html_st) == 0
+	  && html_st.st_mtime >= src_st.st_mtime)
+	{
+	  unchanged++;
+	  continue;
+	}
+      rendered++;
+      if (debugging_output)
+	fprintf (stderr, "Exporting `%s'\n", e->page->path);
+
+      if ((target = so_target (e->page)) != 0)
+	status |= export_stub (out_dir, e, target);
+      else if (e->page->flags & FLAG_FORMATTED)
+	status |= finish_export (out_dir, e, (char *)0);
+      else
+	{
+	  /* "cd /usr/man && groff -man -Thtml -t man1/foo.1 > DIR/foo.1.html~" */
+	  page_root (e->page, root);
+	  sprintf (cmd, "%s \"%s\" > \"%s/%s~\"",
+		   formatter_cmd (e->page, html_groff),
+		   e->page->path + strlen (root) + 1, out_dir, e->html);
+	  if (debugging_output)
+	    fprintf (stderr, "Running `%s' in `%s'\n", cmd, root);
+	  if (chdir (root))
+	    {
+	      fprintf (stderr, "%s: cannot chdir to %s: %s\n",
+		       progname, root, strerror (errno));
+	      status = 1;
+	      continue;
+	    }
+	  if (start_job (cmd, &jobs[njobs]))
+	    {
+	      fprintf (stderr, "%s: cannot render %s\n", progname,
+		       e->page->path);
+	      status = 1;
+	    }
+	  else
+	    job_page[njobs++] = e - exports;
+	  chdir (curdir);
+	}
+    }
+
+  if (verbose_option)
+    fprintf (stderr, "%s: exported %d pages, %d unchanged\n",
+	     progname, rendered, unchanged);
+  free (jobs);
+  free (job_page);
+  for (i = 0; i < nexports; i++)
+    free (exports[i].html);
+  free (exports);
+  exports = (Export_page *)0;
+  nexports = 0;
+  while (next_slot > 0)
+    remove_page (next_slot - 1);
+  return status;
+}
+
+/* Checking a manual tree.
+
+   --check looks at every page in the search path for problems which
+   would keep it from being shown: files which cannot be read, pages
+   which need vgrind, .so requests naming files which are not there,
+   and pre-formatted pages in a catN directory whose manN sibling
+   does not have their source.  The .so requests are followed into
+   the files they name.  --check-render also runs every unformatted
+   page through the formatter, up to -j at a time as for --export,
+   and reports those it fails on.  Each problem is reported on a line
+   of its own, and each kind found sets a bit in the exit status.  */
+
+#define CHECK_UNREADABLE	8
+#define CHECK_VGRIND		16
+#define CHECK_BROKEN_SO		32
+#define CHECK_ORPHANED		64
+#define CHECK_RENDER		128
+
+/* How deep .so requests may nest before we call it a loop.  */
+#define MAX_SO_DEPTH	8
+
+/* Non-zero if --check should also format the pages.  */
+int check_render;
+
+/* Check the .so requests in FILE, which PAGE includes DEPTH levels
+   down; they are resolved relative to ROOT, as groff does when it
+   runs there.  Returns the number of broken ones.  */
+int
+check_so (const Man_page *page, const char *file, const char *root, int depth)
+{
+  Mapped_file mf;
+  const char *p, *end;
+  int broken = 0;
+  size_t root_len = strlen (root);
+
+  if (map_file (file, &mf))
+    return 0;
+  p = (const char *)mf.data;
+  end = p + mf.size;
+  while (p < end)
+    {
+      const char *eol = memchr (p, '\n', end - p), *t, *t_end;
+      char target[FILENAME_MAX], path[FILENAME_MAX];
+
+      if (!eol)
+	eol = end;
+      if (eol - p > 4 && strncmp (p, ".so", 3) == 0
+	  && (p[3] == ' ' || p[3] == '\t'))
+	{
+	  for (t = p + 3; t < eol && (*t == ' ' || *t == '\t'); t++)
+	    ;
+	  for (t_end = t; t_end < eol && !isspace ((unsigned char)*t_end); t_end++)
+	    ;
+	  /* Targets too long to resolve under ROOT are left alone.  */
+	  if (t_end > t && root_len + 1 + (t_end - t) < sizeof path)
+	    {
+	      memcpy (target, t, t_end - t);
+	      target[t_end - t] = '\0';
+	      if (IS_DIR_SEP (target[0])
+#if defined (MSDOS) || defined (__WIN32__)
+		  || target[1] == ':'
+#endif
+		  )
+		strcpy (path, target);
+	      else
+		{
+		  memcpy (path, root, root_len);
+		  path[root_len] = '/';
+		  strcpy (path + root_len + 1, target);
+		}
+	      if (access (path, R_OK) != 0)
+		{
+		  printf ("%s: .so %s: %s\n", page->path, target,
+			  strerror (errno));
+		  broken++;
+		}
+	      else if (depth >= MAX_SO_DEPTH)
+		{
+		  printf ("%s: .so %s: nested too deeply\n", page->path, target);
+		  broken++;
+		}
+	      else
+		broken += check_so (page, path, root, depth + 1);
+	    }
+	}
+      p = eol + 1;
+    }
+  unmap_file (&mf);
+  return broken;
+}
+
+/* Non-zero if PAGE is a pre-formatted page in a catN directory whose
+   sibling manN directory exists but does not have its source.  */
+int
+orphaned_page (const Man_page *page)
+{
+  char source[FILENAME_MAX];
+  size_t dirlen = page->name - page->path - 1;
+
+  if (!(page->flags & FLAG_FORMATTED) || dirlen < 5
+      || strncmp (page->path + dirlen - 5, "/cat", 4) != 0
+      || !strchr (section_letters, page->path[dirlen - 1]))
+    return 0;
+  strcpy (source, page->path);
+  memcpy (source + dirlen - 4, "man", 3);
+  source[dirlen] = '\0';
+  if (!isadir (source))
+    return 0;
+  source[dirlen] = '/';
+  return access (source, F_OK) != 0;
+}
+
+/* Check the pages of section SECTION in the search path.  */
+int
+check_pages (const char *section)
+{
+  char curdir[PATH_MAX], root[PATH_MAX], cmd[3 * FILENAME_MAX];
+  Job_id *jobs;
+  int *job_page;
+  int njobs = 0, checked = 0, status = 0, i;
+  int unreadable = 0, vgrind = 0, broken = 0, orphaned = 0, failed = 0;
+  char *render;
+
+  if (check_render && !getcwd (curdir, sizeof curdir))
+    {
+      fprintf (stderr, "%s: cannot get the current directory: %s\n",
+	       progname, strerror (errno));
+      return 1;
+    }
+
+  page_mode = KEEP_ALL;
+  find_pages (section, "*");
+
+  /* Everything but the rendering is done here, while the pages which
+     need it are marked in RENDER.  */
+  render = (char *)xmalloc (next_slot + 1);
+  for (i = 0; i < next_slot; i++)
+    {
+      Man_page *page = pages[i];
+      int so_broken;
+
+      render[i] = 0;
+      if (page->name[0] == '.' || not_a_page (page->name)
+	  || isadir (page->path))
+	continue;
+      checked++;
+      if (debugging_output)
+	fprintf (stderr, "Checking `%s'\n", page->path);
+      if (page->flags & FLAG_CANT_OPEN)
+	{
+	  printf ("%s: cannot be read\n", page->path);
+	  unreadable++;
+	  continue;
+	}
+      if (page->flags & FLAG_VGRIND)
+	{
+	  printf ("%s: needs vgrind, which is not supported\n", page->path);
+	  vgrind++;
+	  continue;
+	}
+      if (orphaned_page (page))
+	{
+	  printf ("%s: no source for this formatted page\n", page->path);
+	  orphaned++;
+	}
+      if (page->flags & FLAG_FORMATTED)
+	continue;
+      page_root (page, root);
+      so_broken = check_so (page, page->path, root, 0);
+      if (so_broken)
+	broken++;
+      else
+	render[i] = check_render;
+    }
+
+  if (export_jobs < 1)
+    export_jobs = default_jobs ();
+  jobs = (Job_id *)xmalloc (export_jobs * sizeof (Job_id));
+  job_page = (int *)xmalloc (export_jobs * sizeof (int));
+
+  for (i = 0; i < next_slot || njobs > 0; )
+    {
+      Man_page *page;
+
+      /* Reap a job when all are busy or there is nothing left to start.  */
+      if (njobs == export_jobs || i >= next_slot)
+	{
+	  int job_failed, j = wait_job (jobs, njobs, &job_failed);
+
+	  if (job_failed)
+	    {
+	      printf ("%s: the formatter failed on it\n",
+		      pages[job_page[j]]->path);
+	      failed++;
+	    }
+	  jobs[j] = jobs[--njobs];
+	  job_page[j] = job_page[njobs];
+	  continue;
+	}
+
+      page = pages[i++];
+      if (!render[i - 1])
+	continue;
+      page_root (page, root);
+      sprintf (cmd, "%s \"%s\" > %s", formatter_cmd (page, groff),
+	       page->path + strlen (root) + 1, NULL_DEVICE);
+      if (debugging_output)
+	fprintf (stderr, "Running `%s' in `%s'\n", cmd, root);
+      if (chdir (root))
+	{
+	  fprintf (stderr, "%s: cannot chdir to %s: %s\n",
+		   progname, root, strerror (errno));
+	  status = 1;
+	  continue;
+	}
+      if (start_job (cmd, &jobs[njobs]))
+	{
+	  printf ("%s: the formatter could not be run\n", page->path);
+	  failed++;
+	}
+      else
+	job_page[njobs++] = i - 1;
+      chdir (curdir);
+    }
+
+  printf ("%d pages checked: %d unreadable, %d need vgrind, "
+	  "%d with broken .so, %d orphaned", checked, unreadable, vgrind,
+	  broken, orphaned);
+  if (check_render)
+    printf (", %d failed to format", failed);
+  printf ("\n");
+
+  if (unreadable)
+    status |= CHECK_UNREADABLE;
+  if (vgrind)
+    status |= CHECK_VGRIND;
+  if (broken)
+    status |= CHECK_BROKEN_SO;
+  if (orphaned)
+    status |= CHECK_ORPHANED;
+  if (failed)
+    status |= CHECK_RENDER;
+  free (render);
+  free (jobs);
+  free (job_page);
+  while (next_slot > 0)
+    remove_page (next_slot - 1);
+  return status;
+}
+
+/* The cross-reference index.
+
+   `man -u' also records which pages the SEE ALSO section of each page
+   under a MANPATH directory refers to, in the file XRF_NAME at the top
+   of that directory.  A reference is "topic(section)" in the text of
+   the section, perhaps with the topic in another font, or mdoc's
+   ".Xr topic section".  The file holds the graph in compressed sparse
+   rows, so that queries look everything up in the mapped file and
+   never read a page.  All numbers are 32-bit little-endian.  It holds:
+
+     XRF_MAGIC
+     the number of pages, of names and of references
+     the offsets of the page table, the name table, the references
+       and the referrers
+     the page table: for each page, and one entry more, the offset of
+       its file name relative to the top, the number of its own name,
+       its mtime and size, and the place of its first reference
+     the name table: for each name "topic(section)" a page has or
+       refers to, in sorted order, and one entry more, the offset of
+       the name, the number of the first page which has it, and the
+       place of its first referrer
+     the references: for each page, the numbers of the names it
+       refers to
+     the referrers: for each name, the numbers of the pages which
+       refer to it
+     the names and file names, null-terminated
+
+   The pages are in the order of their names, so the pages which have
+   a name are a run of the table.  Updating the index reads only the
+   pages whose mtime or size changed.  */
+
+#define XRF_MAGIC	"man xrf 1\n"
+#define XRF_HEADER	(10 + 7 * 4)	/* the magic and seven numbers */
+#define XRF_PAGE	20		/* the size of a page table entry */
+#define XRF_NAME_ENTRY	12		/* ... and of a name table entry */
+
+/* A page while the index is built.  */
+typedef struct {
+  char *name;		/* relative to the top */
+  char *self;		/* its own name, "topic(section)" */
+  unsigned long mtime, size;
+  unsigned long dev, ino; /* the file, to tell its hard links by */
+  char **refs;		/* the names it refers to */
+  int nrefs, maxrefs;
+  char **aliases;	/* the other topics its NAME section names */
+  int naliases;
+  int known;		/* non-zero once REFS and ALIASES are known */
+  unsigned long key;	/* the number of SELF */
+} Xrf_page;
+
+/* The index of one MANPATH directory, mapped into memory.  */
+typedef struct {
+  Mapped_file file;
+  char *top;
+  unsigned long npages, nnames, nrefs;
+  const unsigned char *pages, *names, *refs, *referrers;
+} Xrf_image;
+
+int
+compare_strings (const void *p1, const void *p2)
+{
+  return strcmp (*(char * const *)p1, *(char * const *)p2);
+}
+
+int
+compare_xrf_names (const void *p1, const void *p2)
+{
+  return strcmp (((const Xrf_page *)p1)->name, ((const Xrf_page *)p2)->name);
+}
+
+/* Order pointers to pages by their files, and the names of each file
+   alphabetically.  */
+int
+compare_xrf_files (const void *p1, const void *p2)
+{
+  const Xrf_page *x1 = *(const Xrf_page * const *)p1;
+  const Xrf_page *x2 = *(const Xrf_page * const *)p2;
+
+  if (x1->dev != x2->dev)
+    return x1->dev < x2->dev ? -1 : 1;
+  if (x1->ino != x2->ino)
+    return x1->ino < x2->ino ? -1 : 1;
+  return strcmp (x1->name, x2->name);
+}
+
+int
+compare_xrf_keys (const void *p1, const void *p2)
+{
+  const Xrf_page *x1 = (const Xrf_page *)p1, *x2 = (const Xrf_page *)p2;
+
+  if (x1->key != x2->key)
+    return x1->key < x2->key ? -1 : 1;
+  return strcmp (x1->name, x2->name);
+}
+
+/* Add the reference REF to PAGE, unless it has it already or REF is
+   the page itself, as in the running headers of formatted pages.  */
+void
+add_xref (Xrf_page *page, const char *ref)
+{
+  char folded[FILENAME_MAX], self[FILENAME_MAX];
+  int i;
+
+  if (strlen (ref) < sizeof folded && strlen (page->self) < sizeof self
+      && strcmp (fnmatch_fold_key (folded, ref),
+		 fnmatch_fold_key (self, page->self)) == 0)
+    return;
+  for (i = 0; i < page->nrefs; i++)
+    if (strcmp (page->refs[i], ref) == 0)
+      return;
+  if (page->nrefs >= page->maxrefs)
+    {
+      page->maxrefs = page->maxrefs ? 2 * page->maxrefs : 8;
+      page->refs = (char **)xrealloc (page->refs,
+				      page->maxrefs * sizeof (char *));
+    }
+  page->refs[page->nrefs++] = strcpy ((char *)xmalloc (strlen (ref) + 1), ref);
+}
+
+/* Add the references "topic(section)" in TEXT, a line of the SEE ALSO
+   section without its fonts and quotes, to PAGE.  A section is a
+   digit perhaps followed by letters, like "3" or "3head".  */
+void
+scan_xrefs (Xrf_page *page, const char *text)
+{
+  const char *p = text;
+  char ref[FILENAME_MAX];
+
+  while ((p = strchr (p, '(')) != 0)
+    {
+      const char *sec = ++p, *sec_end = sec, *name, *name_end = p - 1;
+
+      if (!isdigit ((unsigned char)*sec))
+	continue;
+      for (sec_end++; isalpha ((unsigned char)*sec_end); sec_end++)
+	;
+      if (*sec_end != ')')
+	continue;
+      /* ".BR printf (3)" sets the two words without a blank.  */
+      while (name_end > text && name_end[-1] == ' ')
+	name_end--;
+      for (name = name_end; name > text && IS_XREF_CHAR (name[-1]); name--)
+	;
+      if (name == name_end || *name == '.'
+	  || (size_t)(sec_end - name) + 2 > sizeof ref)
+	continue;
+      sprintf (ref, "%.*s(%.*s)", (int)(name_end - name), name,
+	       (int)(sec_end - sec), sec);
+      add_xref (page, ref);
+    }
+}
+
+/* Add the topics in NAMES, the text of the NAME section up to the
+   dash before the description, to the aliases of PAGE, but for the
+   topic of the page itself and those it has already.  */
+void
+scan_aliases (Xrf_page *page, char *names)
+{
+  char folded[FILENAME_MAX], self[FILENAME_MAX];
+  char *alias;
+  int i;
+
+  if (strlen (page->self) >= sizeof self)
+    return;
+  fnmatch_fold_key (self, page->self);
+  if ((alias = strrchr (self, '(')) != 0)
+    *alias = '\0';
+  for (alias = strtok (names, ", \t"); alias; alias = strtok ((char *)0, ", \t"))
+    {
+      if (strlen (alias) >= sizeof folded
+	  || strcmp (fnmatch_fold_key (folded, alias), self) == 0)
+	continue;
+      for (i = 0; i < page->naliases; i++)
+	if (strcmp (page->aliases[i], alias) == 0)
+	  break;
+      if (i < page->naliases)
+	continue;
+      page->aliases = (char **)xrealloc (page->aliases, (page->naliases + 1)
+					 * sizeof (char *));
+      page->aliases[page->naliases++] = strcpy ((char *)xmalloc (strlen (alias)
+								 + 1), alias);
+    }
+}
+
+/* Add the references in the SEE ALSO section of the page TEXT of SIZE
+   bytes to PAGE, and the topics its NAME section names to its
+   aliases.  Headings are told as --section-heading does.  */
+void
+read_xrefs (Xrf_page *page, const char *text, size_t size)
+{
+  const char *p = text, *end = text + size;
+  int formatted = size > 0 && text[0] != '.' && text[0] != '\'';
+  int in_see_also = 0, in_name = 0;
+  char line_text[1024], see_also[10], name_heading[10], names[1024];
+  size_t names_len = 0;
+
+  fnmatch_fold_key (see_also, "SEE ALSO");
+  fnmatch_fold_key (name_heading, "NAME");
+  while (p < end)
+    {
+      const char *line = p, *eol = (const char *)memchr (p, '\n', end - p);
+      const char *next = eol ? eol + 1 : end, *htext, *c;
+      int level = 0;
+
+      if (formatted)
+	{
+	  if (line > text && !isspace ((unsigned char)*line))
+	    {
+	      heading_text (line, next, line_text, sizeof line_text);
+	      for (c = line_text; *c && !islower ((unsigned char)*c); c++)
+		;
+	      level = *c == '\0' && !strchr (line_text, '(');
+	    }
+	}
+      else if ((level = roff_heading (line, next, &htext)) > 0)
+	{
+	  heading_text (htext, next, line_text, sizeof line_text);
+	  if (!line_text[0] && next < end)
+	    {
+	      const char *after = (const char *)memchr (next, '\n', end - next);
+
+	      heading_text (next, after ? after : end, line_text,
+			    sizeof line_text);
+	      next = after ? after + 1 : end;
+	    }
+	}
+
+      if (level == 1)
+	{
+	  fnmatch_fold_key (line_text, line_text);
+	  in_see_also = strcmp (line_text, see_also) == 0;
+	  in_name = strcmp (line_text, name_heading) == 0;
+	}
+      else if (in_name && level == 0)
+	{
+	  const char *s = line;
+	  int description = 0;
+
+	  /* "printf, fprintf \- formatted output conversion", perhaps in
+	     a font or two, or mdoc's ".Nm printf , fprintf" lines up to
+	     the ".Nd".  */
+	  if (!formatted && (*s == '.' || *s == '\''))
+	    {
+	      for (s++; s < next && (*s == ' ' || *s == '\t'); s++)
+		;
+	      if (next - s >= 2 && strncmp (s, "Nd", 2) == 0)
+		description = 1;
+	      else if (s < next && *s == '\\')
+		s = next;	/* a comment */
+	      else
+		while (s < next && !isspace ((unsigned char)*s))
+		  s++;
+	    }
+	  if (description)
+	    strcpy (line_text, "- ");
+	  else if (s == next)
+	    line_text[0] = '\0';
+	  else
+	    heading_text (s, next, line_text, sizeof line_text);
+	  if (names_len + strlen (line_text) + 2 < sizeof names)
+	    {
+	      names[names_len++] = ' ';
+	      strcpy (names + names_len, line_text);
+	      names_len += strlen (line_text);
+	    }
+	}
+      else if (in_see_also && level == 0)
+	{
+	  char topic[FILENAME_MAX], sec[16], ref[FILENAME_MAX + 18];
+
+	  if (!formatted && next - line > 4 && strncmp (line, ".Xr", 3) == 0)
+	    {
+	      heading_text (line + 3, next, line_text, sizeof line_text);
+	      if (strlen (line_text) < sizeof topic
+		  && sscanf (line_text, "%s %15[0-9a-zA-Z]", topic, sec) == 2
+		  && isdigit ((unsigned char)sec[0]))
+		{
+		  sprintf (ref, "%s(%s)", topic, sec);
+		  add_xref (page, ref);
+		}
+	    }
+	  else
+	    {
+	      heading_text (line, next, line_text, sizeof line_text);
+	      scan_xrefs (page, line_text);
+	    }
+	}
+      p = next;
+    }
+
+  if (names_len > 0)
+    {
+      char *dash;
+
+      names[names_len] = '\0';
+      for (dash = strstr (names, " -"); dash; dash = strstr (dash + 1, " -"))
+	if (dash[2] == ' ' || dash[2] == '-')
+	  break;
+      if (dash)
+	{
+	  *dash = '\0';
+	  scan_aliases (page, names);
+	}
+    }
+}
+
+/* Add the regular files among the NAMES in subdirectory SUBDIR of TOP
+   ("." for TOP itself) to the NPAGES pages in PAGES, which has room
+   for MAXPAGES.  */
+void
+add_xrf_pages (const char *top, const char *subdir, char **names,
+	       int count, Xrf_page **pages, unsigned long *npages,
+	       unsigned long *maxpages)
+{
+  char path[FILENAME_MAX];
+  struct stat st;
+  int i;
+
+  for (i = 0; i < count; i++)
+    {
+      const char *dot = strrchr (names[i], '.');
+      Xrf_page *x;
+
+      if (!dot || dot == names[i] || !dot[1] || not_a_page (names[i]))
+	continue;
+      if (strcmp (subdir, ".") == 0)
+	sprintf (path, "%s/%s", top, names[i]);
+      else
+	sprintf (path, "%s/%s/%s", top, subdir, names[i]);
+      if (stat (path, &st) || !S_ISREG (st.st_mode))
+	continue;
+      if (*npages >= *maxpages)
+	{
+	  *maxpages = *maxpages ? 2 * *maxpages : 64;
+	  *pages = (Xrf_page *)xrealloc (*pages,
+					 *maxpages * sizeof (Xrf_page));
+	}
+      x = &(*pages)[(*npages)++];
+      x->name = (char *)xmalloc (strlen (path) - strlen (top));
+      strcpy (x->name, path + strlen (top) + 1);
+      x->self = (char *)xmalloc (strlen (names[i]) + 2);
+      sprintf (x->self, "%.*s(%s)", (int)(dot - names[i]), names[i], dot + 1);
+      x->mtime = (unsigned long)st.st_mtime;
+      x->size = (unsigned long)st.st_size;
+      x->dev = (unsigned long)st.st_dev;
+      x->ino = (unsigned long)st.st_ino;
+      x->refs = (char **)0;
+      x->nrefs = x->maxrefs = 0;
+      x->aliases = (char **)0;
+      x->naliases = 0;
+      x->known = 0;
+    }
+}
+
+/* Map the cross-reference index of TOP into IMG.  Returns zero on
+   success.  */
+int
+open_xrf (const char *top, Xrf_image *img)
+{
+  char file[FILENAME_MAX];
+  const unsigned char *d;
+  size_t size;
+  unsigned long pages_off, names_off, refs_off, referrers_off;
+
+  sprintf (file, "%s/%s", top, XRF_NAME);
+  if (map_file (file, &img->file))
+    return -1;
+  d = img->file.data;
+  size = img->file.size;
+  if (size < XRF_HEADER || memcmp (d, XRF_MAGIC, 10) != 0)
+    goto bad;
+  img->npages = get_u32 (d + 10);
+  img->nnames = get_u32 (d + 14);
+  img->nrefs = get_u32 (d + 18);
+  pages_off = get_u32 (d + 22);
+  names_off = get_u32 (d + 26);
+  refs_off = get_u32 (d + 30);
+  referrers_off = get_u32 (d + 34);
+  if (img->npages > size || img->nnames > size || img->nrefs > size
+      || pages_off + XRF_PAGE * (img->npages + 1) > size
+      || names_off + XRF_NAME_ENTRY * (img->nnames + 1) > size
+      || refs_off + 4 * img->nrefs > size
+      || referrers_off + 4 * img->nrefs > size)
+    goto bad;
+  img->pages = d + pages_off;
+  img->names = d + names_off;
+  img->refs = d + refs_off;
+  img->referrers = d + referrers_off;
+  img->top = strcpy ((char *)xmalloc (strlen (top) + 1), top);
+  return 0;
+
+ bad:
+  if (verbose_option)
+    fprintf (stderr, "%s: %s is unusable, ignoring it\n", progname, file);
+  unmap_file (&img->file);
+  return -1;
+}
+
+/* The string at offset OFF in IMG, or "" if it is damaged.  */
+const char *
+xrf_string (const Xrf_image *img, unsigned long off)
+{
+  if (off >= img->file.size
+      || !memchr (img->file.data + off, '\0', img->file.size - off))
+    return "";
+  return (const char *)img->file.data + off;
+}
+
+/* Field FIELD of entry N of the page table, or of the name table.  */
+#define XRF_PAGE_FIELD(img, n, field) \
+  get_u32 ((img)->pages + XRF_PAGE * (n) + 4 * (field))
+#define XRF_NAME_FIELD(img, n, field) \
+  get_u32 ((img)->names + XRF_NAME_ENTRY * (n) + 4 * (field))
+
+const char *
+xrf_name (const Xrf_image *img, unsigned long n)
+{
+  if (n > img->nnames)
+    return "";
+  return xrf_string (img, XRF_NAME_FIELD (img, n, 0));
+}
+
+/* The number of the first name in IMG which does not sort before
+   KEY.  */
+unsigned long
+xrf_lower_bound (const Xrf_image *img, const char *key)
+{
+  unsigned long lo = 0, hi = img->nnames;
+
+  while (lo < hi)
+    {
+      unsigned long mid = lo + (hi - lo) / 2;
+
+      if (strcmp (xrf_name (img, mid), key) < 0)
+	lo = mid + 1;
+      else
+	hi = mid;
+    }
+  return lo;
+}
+
+/* The run of pages in IMG which have name N: *FIRST up to *LAST.  */
+void
+xrf_name_pages (const Xrf_image *img, unsigned long n,
+		unsigned long *first, unsigned long *last)
+{
+  *first = XRF_NAME_FIELD (img, n, 1);
+  *last = XRF_NAME_FIELD (img, n + 1, 1);
+  if (*last > img->npages)
+    *last = img->npages;
+  if (*first > *last)
+    *first = *last;
+}
+
+/* The alias index.
+
+   A page often documents several topics, like printf(3), whose NAME
+   section names fprintf, sprintf and the rest, and without a .so stub
+   for each of them the file names do not tell where they are.  So
+   while `man -u' reads the pages for the cross-reference index, it
+   also writes down the topics of their NAME sections, in the file
+   ALS_NAME at the top of each MANPATH directory.  It is a hash table
+   of the topics, so that a topic is found in one step, without
+   reading a directory or a page; man_entry looks there when no page
+   file has the name asked for.  The topics are hashed folded as
+   FNM_CASEFOLD compares them, so the same file serves for systems
+   which fold case and those which do not.  It holds, in 32-bit
+   little-endian numbers:
+
+     ALS_MAGIC
+     the number of buckets and of entries
+     the offsets of the buckets and of the entries
+     the buckets: for each one, and one more, the number of its first
+       entry
+     the entries: the offset of the topic and of the file name of its
+       page, relative to the top
+     the topics and file names, null-terminated  */
+
+#define ALS_MAGIC	"man als 1\n"
+#define ALS_HEADER	(10 + 4 * 4)	/* the magic and four numbers */
+#define ALS_ENTRY	8		/* the size of an entry */
+
+/* The alias index of one MANPATH directory, mapped into memory.  */
+typedef struct {
+  Mapped_file file;
+  unsigned long nbuckets, nentries;
+  const unsigned char *buckets, *entries;
+} Als_image;
+
+/* The hash of the topic NAME, folded.  */
+unsigned long
+als_hash (const char *name)
+{
+  char folded[FILENAME_MAX];
+  const char *p;
+  unsigned long h = 2166136261UL;
+
+  if (strlen (name) >= sizeof folded)
+    return 0;
+  for (p = fnmatch_fold_key (folded, name); *p; p++)
+    h = ((h ^ (unsigned char)*p) * 16777619UL) & 0xffffffffUL;
+  return h;
+}
+
+/* Map the alias index of TOP into IMG.  Returns zero on success.  */
+int
+open_als (const char *top, Als_image *img)
+{
+  char file[FILENAME_MAX];
+  const unsigned char *d;
+  size_t size;
+  unsigned long buckets_off, entries_off;
+
+  sprintf (file, "%s/%s", top, ALS_NAME);
+  if (map_file (file, &img->file))
+    return -1;
+  d = img->file.data;
+  size = img->file.size;
+  if (size < ALS_HEADER || memcmp (d, ALS_MAGIC, 10) != 0)
+    goto bad;
+  img->nbuckets = get_u32 (d + 10);
+  img->nentries = get_u32 (d + 14);
+  buckets_off = get_u32 (d + 18);
+  entries_off = get_u32 (d + 22);
+  if (img->nbuckets == 0 || img->nbuckets > size || img->nentries > size
+      || buckets_off + 4 * (img->nbuckets + 1) > size
+      || entries_off + ALS_ENTRY * img->nentries > size)
+    goto bad;
+  img->buckets = d + buckets_off;
+  img->entries = d + entries_off;
+  return 0;
+
+ bad:
+  if (verbose_option)
+    fprintf (stderr, "%s: %s is unusable, ignoring it\n", progname, file);
+  unmap_file (&img->file);
+  return -1;
+}
+
+/* The string at offset OFF in IMG, or "" if it is damaged.  */
+const char *
+als_string (const Als_image *img, unsigned long off)
+{
+  if (off >= img->file.size
+      || !memchr (img->file.data + off, '\0', img->file.size - off))
+    return "";
+  return (const char *)img->file.data + off;
+}
+
+/* The topic of entry N of IMG, and the file name of its page.  */
+#define ALS_TOPIC(img, n) \
+  als_string ((img), get_u32 ((img)->entries + ALS_ENTRY * (n)))
+#define ALS_FILE(img, n) \
+  als_string ((img), get_u32 ((img)->entries + ALS_ENTRY * (n) + 4))
+
+/* The entries of IMG in the bucket of the topic hashed to HASH:
+   *FIRST up to *LAST.  */
+void
+als_bucket (const Als_image *img, unsigned long hash,
+	    unsigned long *first, unsigned long *last)
+{
+  unsigned long b = hash % img->nbuckets;
+
+  *first = get_u32 (img->buckets + 4 * b);
+  *last = get_u32 (img->buckets + 4 * (b + 1));
+  if (*last > img->nentries)
+    *last = img->nentries;
+  if (*first > *last)
+    *first = *last;
+}
+
+/* Write the alias index of TOP for the NPAGES pages in PAGES.  A file
+   with several names is entered under the one which sorts first only,
+   so that a lookup through the index finds it once.  Returns non-zero
+   if it could not be written.  */
+int
+write_als (const char *top, const Xrf_page *pages, unsigned long npages)
+{
+  char file[FILENAME_MAX], temp[FILENAME_MAX];
+  unsigned long nentries = 0, nbuckets, i, off, topics_off;
+  unsigned long *row, *fill, *hash, *entry_page, *name_off;
+  const char **entry_topic;
+  char *linked;
+  Byte_buf out;
+  FILE *fp;
+  int j, status = 0;
+
+  /* LINKED[I] is non-zero if page I is another name of a file which
+     is entered.  */
+  linked = (char *)xmalloc (npages + 1);
+  memset (linked, 0, npages + 1);
+#if !defined (MSDOS) && !defined (__WIN32__)
+  {
+    const Xrf_page **by_file;
+    unsigned long n = 0;
+
+    by_file = (const Xrf_page **)xmalloc ((npages + 1)
+					  * sizeof (Xrf_page *));
+    for (i = 0; i < npages; i++)
+      if (pages[i].naliases > 0)
+	by_file[n++] = &pages[i];
+    qsort (by_file, n, sizeof (Xrf_page *), compare_xrf_files);
+    for (i = 1; i < n; i++)
+      if (by_file[i]->dev == by_file[i - 1]->dev
+	  && by_file[i]->ino == by_file[i - 1]->ino)
+	linked[by_file[i] - pages] = 1;
+    free (by_file);
+  }
+#endif
+
+  for (i = 0; i < npages; i++)
+    if (!linked[i])
+      nentries += pages[i].naliases;
+  nbuckets = nentries + 1;
+
+  /* Put the entries in the order of their buckets.  */
+  row = (unsigned long *)xmalloc ((nbuckets + 1) * sizeof (unsigned long));
+  fill = (unsigned long *)xmalloc ((nbuckets + 1) * sizeof (unsigned long));
+  hash = (unsigned long *)xmalloc ((nentries + 1) * sizeof (unsigned long));
+  entry_page = (unsigned long *)xmalloc ((nentries + 1)
+					 * sizeof (unsigned long));
+  entry_topic = (const char **)xmalloc ((nentries + 1) * sizeof (char *));
+  memset (row, 0, (nbuckets + 1) * sizeof (unsigned long));
+  for (i = 0, off = 0; i < npages; i++)
+    for (j = 0; !linked[i] && j < pages[i].naliases; j++)
+      {
+	hash[off] = als_hash (pages[i].aliases[j]) % nbuckets;
+	row[hash[off++] + 1]++;
+      }
+  for (i = 0; i < nbuckets; i++)
+    row[i + 1] += row[i];
+  memcpy (fill, row, (nbuckets + 1) * sizeof (unsigned long));
+  for (i = 0, off = 0; i < npages; i++)
+    for (j = 0; !linked[i] && j < pages[i].naliases; j++)
+      {
+	unsigned long e = fill[hash[off++]]++;
+
+	entry_page[e] = i;
+	entry_topic[e] = pages[i].aliases[j];
+      }
+
+  memset (&out, 0, sizeof out);
+  put_bytes (&out, ALS_MAGIC, 10);
+  put_u32 (&out, nbuckets);
+  put_u32 (&out, nentries);
+  put_u32 (&out, ALS_HEADER);
+  put_u32 (&out, ALS_HEADER + 4 * (nbuckets + 1));
+  for (i = 0; i <= nbuckets; i++)
+    put_u32 (&out, row[i]);
+
+  /* The topics come after the entries, and after them the file names
+     of the pages which have aliases.  */
+  topics_off = off = ALS_HEADER + 4 * (nbuckets + 1) + ALS_ENTRY * nentries;
+  for (i = 0; i < nentries; i++)
+    off += strlen (entry_topic[i]) + 1;
+  name_off = (unsigned long *)xmalloc ((npages + 1) * sizeof (unsigned long));
+  for (i = 0; i < npages; i++)
+    if (!linked[i] && pages[i].naliases > 0)
+      {
+	name_off[i] = off;
+	off += strlen (pages[i].name) + 1;
+      }
+  for (i = 0, off = topics_off; i < nentries; i++)
+    {
+      put_u32 (&out, off);
+      put_u32 (&out, name_off[entry_page[i]]);
+      off += strlen (entry_topic[i]) + 1;
+    }
+  for (i = 0; i < nentries; i++)
+    put_bytes (&out, entry_topic[i], strlen (entry_topic[i]) + 1);
+  for (i = 0; i < npages; i++)
+    if (!linked[i] && pages[i].naliases > 0)
+      put_bytes (&out, pages[i].name, strlen (pages[i].name) + 1);
+
+  sprintf (file, "%s/%s", top, ALS_NAME);
+  sprintf (temp, "%s/%s", top, ALS_TEMP);
+  if ((fp = fopen (temp, "wb")) == 0)
+    status = 1;
+  else
+    {
+      fwrite (out.data, 1, out.len, fp);
+      if (ferror (fp) | fclose (fp) || replace_file (temp, file))
+	{
+	  remove (temp);
+	  status = 1;
+	}
+    }
+  if (status)
+    fprintf (stderr, "%s: cannot write %s: %s\n", progname, file,
+	     strerror (errno));
+  else if (verbose_option)
+    fprintf (stderr, "%s: %s: %lu aliases\n", progname, file, nentries);
+
+  free (out.data);
+  free (row);
+  free (fill);
+  free (hash);
+  free (entry_page);
+  free (linked);
+  free (name_off);
+  free (entry_topic);
+  return status;
+}
+
+/* Bring the cross-reference index of TOP up to date.  */
+int
+update_xrf (const char *top)
+{
+  char file[FILENAME_MAX], temp[FILENAME_MAX], path[FILENAME_MAX];
+  Dir_listing top_dir;
+  Man_index *idx;
+  Xrf_page *pages = (Xrf_page *)0;
+  Xrf_image old;
+  Als_image old_als;
+  unsigned long npages = 0, maxpages = 0, nnames = 0, nrefs = 0, nread = 0;
+  unsigned long *row, *fill, *referrers, i, off;
+  char **names;
+  Byte_buf out;
+  FILE *fp;
+  int d, j, status = 0;
+
+  top_dir.name = ".";
+  if (read_listing (&top_dir, top))
+    return 1;
+  idx = read_index (top);
+  add_xrf_pages (top, ".", top_dir.names, top_dir.count, &pages, &npages,
+		 &maxpages);
+  for (d = 0; d < idx->ndirs; d++)
+    add_xrf_pages (top, idx->dirs[d].name, idx->dirs[d].names,
+		   idx->dirs[d].count, &pages, &npages, &maxpages);
+  free_index (idx);
+  free (top_dir.names);
+  free (top_dir.storage);
+
+  /* Take the references of the pages which did not change from the
+     old index, and read the others.  */
+  qsort (pages, npages, sizeof (Xrf_page), compare_xrf_names);
+  if (open_xrf (top, &old) == 0)
+    {
+      for (i = 0; i < old.npages; i++)
+	{
+	  Xrf_page key, *x;
+	  unsigned long r, r_end;
+
+	  key.name = (char *)xrf_string (&old, XRF_PAGE_FIELD (&old, i, 0));
+	  x = (Xrf_page *)bsearch (&key, pages, npages, sizeof (Xrf_page),
+				   compare_xrf_names);
+	  if (!x || x->mtime != XRF_PAGE_FIELD (&old, i, 2)
+	      || x->size != XRF_PAGE_FIELD (&old, i, 3))
+	    continue;
+	  r_end = XRF_PAGE_FIELD (&old, i + 1, 4);
+	  for (r = XRF_PAGE_FIELD (&old, i, 4); r < r_end && r < old.nrefs; r++)
+	    {
+	      unsigned long n = get_u32 (old.refs + 4 * r);
+
+	      if (n < old.nnames)
+		add_xref (x, xrf_name (&old, n));
+	    }
+	  x->known = 1;
+	}
+      unmap_file (&old.file);
+      free (old.top);
+    }
+  if (open_als (top, &old_als) == 0)
+    {
+      for (i = 0; i < old_als.nentries; i++)
+	{
+	  Xrf_page key, *x;
+
+	  key.name = (char *)ALS_FILE (&old_als, i);
+	  x = (Xrf_page *)bsearch (&key, pages, npages, sizeof (Xrf_page),
+				   compare_xrf_names);
+	  if (x && x->known)
+	    {
+	      char alias[FILENAME_MAX];
+
+	      strcpy (alias, ALS_TOPIC (&old_als, i));
+	      scan_aliases (x, alias);
+	    }
+	}
+      unmap_file (&old_als.file);
+    }
+  else
+    /* The aliases of the pages are not known: read them all.  */
+    for (i = 0; i < npages; i++)
+      pages[i].known = 0;
+  for (i = 0; i < npages; i++)
+    {
+      Mapped_file mf;
+
+      if (pages[i].known)
+	continue;
+      sprintf (path, "%s/%s", top, pages[i].name);
+      if (debugging_output)
+	fprintf (stderr, "Reading the references of `%s'\n", path);
+      nread++;
+      if (map_file (path, &mf))
+	continue;
+      read_xrefs (&pages[i], (const char *)mf.data, mf.size);
+      unmap_file (&mf);
+    }
+
+  /* Number the names, then order the pages by them.  */
+  for (i = 0; i < npages; i++)
+    nrefs += pages[i].nrefs;
+  names = (char **)xmalloc ((npages + nrefs + 1) * sizeof (char *));
+  for (i = 0; i < npages; i++)
+    {
+      names[nnames++] = pages[i].self;
+      for (j = 0; j < pages[i].nrefs; j++)
+	names[nnames++] = pages[i].refs[j];
+    }
+  qsort (names, nnames, sizeof (char *), compare_strings);
+  for (i = 0, off = 0; i < nnames; i++)
+    if (off == 0 || strcmp (names[off - 1], names[i]) != 0)
+      names[off++] = names[i];
+  nnames = off;
+  for (i = 0; i < npages; i++)
+    pages[i].key = (char **)bsearch (&pages[i].self, names, nnames,
+				     sizeof (char *), compare_strings) - names;
+  qsort (pages, npages, sizeof (Xrf_page), compare_xrf_keys);
+
+  /* The referrers of each name, as rows.  */
+  row = (unsigned long *)xmalloc ((nnames + 1) * sizeof (unsigned long));
+  fill = (unsigned long *)xmalloc ((nnames + 1) * sizeof (unsigned long));
+  referrers = (unsigned long *)xmalloc ((nrefs + 1) * sizeof (unsigned long));
+  memset (row, 0, (nnames + 1) * sizeof (unsigned long));
+  for (i = 0; i < npages; i++)
+    for (j = 0; j < pages[i].nrefs; j++)
+      row[(char **)bsearch (&pages[i].refs[j], names, nnames, sizeof (char *),
+			    compare_strings) - names + 1]++;
+  for (i = 0; i < nnames; i++)
+    row[i + 1] += row[i];
+  memcpy (fill, row, (nnames + 1) * sizeof (unsigned long));
+
+  memset (&out, 0, sizeof out);
+  put_bytes (&out, XRF_MAGIC, 10);
+  put_u32 (&out, npages);
+  put_u32 (&out, nnames);
+  put_u32 (&out, nrefs);
+  off = XRF_HEADER;
+  put_u32 (&out, off);
+  off += XRF_PAGE * (npages + 1);
+  put_u32 (&out, off);
+  off += XRF_NAME_ENTRY * (nnames + 1);
+  put_u32 (&out, off);
+  off += 4 * nrefs;
+  put_u32 (&out, off);
+  off += 4 * nrefs;
+
+  /* The page table; the strings come last, names before file names.  */
+  for (i = 0; i < nnames; i++)
+    off += strlen (names[i]) + 1;
+  for (i = 0, nrefs = 0; i <= npages; i++)
+    {
+      put_u32 (&out, i < npages ? off : 0);
+      put_u32 (&out, i < npages ? pages[i].key : 0);
+      put_u32 (&out, i < npages ? pages[i].mtime : 0);
+      put_u32 (&out, i < npages ? pages[i].size : 0);
+      put_u32 (&out, nrefs);
+      if (i < npages)
+	{
+	  off += strlen (pages[i].name) + 1;
+	  nrefs += pages[i].nrefs;
+	}
+    }
+
+  /* The name table.  */
+  off = XRF_HEADER + XRF_PAGE * (npages + 1) + XRF_NAME_ENTRY * (nnames + 1)
+	+ 8 * nrefs;
+  for (i = 0, j = 0; i <= nnames; i++)
+    {
+      while ((unsigned long)j < npages && pages[j].key < i)
+	j++;
+      put_u32 (&out, i < nnames ? off : 0);
+      put_u32 (&out, j);
+      put_u32 (&out, row[i]);
+      if (i < nnames)
+	off += strlen (names[i]) + 1;
+    }
+
+  /* The references, sorted for each page, and the referrers.  */
+  for (i = 0; i < npages; i++)
+    {
+      unsigned long *ids = (unsigned long *)xmalloc ((pages[i].nrefs + 1)
+						     * sizeof (unsigned long));
+      int k;
+
+      for (j = 0; j < pages[i].nrefs; j++)
+	ids[j] = (char **)bsearch (&pages[i].refs[j], names, nnames,
+				   sizeof (char *), compare_strings) - names;
+      /* Few references: sort them by insertion.  */
+      for (j = 1; j < pages[i].nrefs; j++)
+	for (k = j; k > 0 && ids[k - 1] > ids[k]; k--)
+	  {
+	    unsigned long t = ids[k];
+
+	    ids[k] = ids[k - 1];
+	    ids[k - 1] = t;
+	  }
+      for (j = 0; j < pages[i].nrefs; j++)
+	{
+	  put_u32 (&out, ids[j]);
+	  referrers[fill[ids[j]]++] = i;
+	}
+      free (ids);
+    }
+  for (i = 0; i < nrefs; i++)
+    put_u32 (&out, referrers[i]);
+  for (i = 0; i < nnames; i++)
+    put_bytes (&out, names[i], strlen (names[i]) + 1);
+  for (i = 0; i < npages; i++)
+    put_bytes (&out, pages[i].name, strlen (pages[i].name) + 1);
+
+  sprintf (file, "%s/%s", top, XRF_NAME);
+  sprintf (temp, "%s/%s", top, XRF_TEMP);
+  if ((fp = fopen (temp, "wb")) == 0)
+    status = 1;
+  else
+    {
+      fwrite (out.data, 1, out.len, fp);
+      if (ferror (fp) | fclose (fp) || replace_file (temp, file))
+	{
+	  remove (temp);
+	  status = 1;
+	}
+    }
+  if (status)
+    fprintf (stderr, "%s: cannot write %s: %s\n", progname, file,
+	     strerror (errno));
+  else if (verbose_option)
+    fprintf (stderr, "%s: %s: %lu pages, %lu of them read, %lu references\n",
+	     progname, file, npages, nread, nrefs);
+  status |= write_als (top, pages, npages);
+
+  free (out.data);
+  free (row);
+  free (fill);
+  free (referrers);
+  free (names);
+  for (i = 0; i < npages; i++)
+    {
+      for (j = 0; j < pages[i].nrefs; j++)
+	free (pages[i].refs[j]);
+      free (pages[i].refs);
+      for (j = 0; j < pages[i].naliases; j++)
+	free (pages[i].aliases[j]);
+      free (pages[i].aliases);
+      free (pages[i].name);
+      free (pages[i].self);
+    }
+  free (pages);
+  return status;
+}
+
+/* Bring the cross-reference indices of all the MANPATH directories up
+   to date.  */
+int
+update_xrefs (void)
+{
+  const char *list = search_roots ();
+  char top[FILENAME_MAX];
+  int status = 0;
+
+  while (next_path_dir (&list, top))
+    status |= update_xrf (top);
+  return status;
+}
+
+/* Querying the cross-reference indices.  */
+
+static Xrf_image *xrf_images;
+static int nxrf_images;
+
+/* Map the cross-reference indices of the search path.  */
+void
+open_xrf_images (void)
+{
+  const char *list = search_roots ();
+  char top[FILENAME_MAX];
+
+  while (next_path_dir (&list, top))
+    {
+      xrf_images = (Xrf_image *)xrealloc (xrf_images, (nxrf_images + 1)
+					  * sizeof (Xrf_image));
+      if (open_xrf (top, &xrf_images[nxrf_images]) == 0)
+	nxrf_images++;
+      else if (verbose_option)
+	fprintf (stderr, "%s: %s has no cross-reference index; try `man -u'\n",
+		 progname, top);
+    }
+}
+
+void
+close_xrf_images (void)
+{
+  while (nxrf_images > 0)
+    {
+      Xrf_image *img = &xrf_images[--nxrf_images];
+
+      unmap_file (&img->file);
+      free (img->top);
+    }
+  free (xrf_images);
+  xrf_images = (Xrf_image *)0;
+}
+
+/* Non-zero if NAME, "topic(section)", is TOPIC in a section SECTION
+   selects: any section for "*", else those which start with it.  */
+int
+xrf_name_matches (const char *name, const char *topic, const char *section)
+{
+  size_t len = strlen (topic);
+
+  return (strncmp (name, topic, len) == 0 && name[len] == '('
+	  && (*section == '*'
+	      || strncmp (name + len + 1, section, strlen (section)) == 0));
+}
+
+/* The first name in IMG which is TOPIC in some section.  */
+unsigned long
+xrf_topic_names (const Xrf_image *img, const char *topic)
+{
+  char prefix[FILENAME_MAX];
+
+  if (strlen (topic) + 2 > sizeof prefix)
+    return img->nnames;
+  return xrf_lower_bound (img, strcat (strcpy (prefix, topic), "("));
+}
+
+/* Find a page which answers the reference REF, "topic(section)": one
+   by that name, or else one whose section starts with that of REF, as
+   `man SECTION TOPIC' would find.  Returns the index which has it and
+   stores the number of the page in *PAGE, or returns null.  */
+const Xrf_image *
+resolve_xref (const char *ref, unsigned long *page)
+{
+  char prefix[FILENAME_MAX];
+  size_t len = strlen (ref);
+  int i;
+
+  if (len < 2 || len > sizeof prefix)
+    return (Xrf_image *)0;
+  memcpy (prefix, ref, --len);
+  prefix[len] = '\0';
+  for (i = 0; i < nxrf_images; i++)
+    {
+      const Xrf_image *img = &xrf_images[i];
+      unsigned long n, first, last;
+
+      for (n = xrf_lower_bound (img, prefix);
+	   n < img->nnames && strncmp (xrf_name (img, n), prefix, len) == 0;
+	   n++)
+	{
+	  xrf_name_pages (img, n, &first, &last);
+	  if (first < last)
+	    {
+	      *page = first;
+	      return img;
+	    }
+	}
+    }
+  return (Xrf_image *)0;
+}
+
+/* Print the line "section<TAB>topic<TAB>path" for NAME, "topic(section)",
+   and page PAGE of IMG, or with an empty path if IMG is null.  */
+void
+print_xref (const char *name, const Xrf_image *img, unsigned long page)
+{
+  const char *paren = strrchr (name, '(');
+
+  if (!paren)
+    return;
+  printf ("%.*s\t%.*s\t", (int)strlen (paren + 1) - 1, paren + 1,
+	  (int)(paren - name), name);
+  if (img)
+    printf ("%s/%s", img->top, xrf_string (img, XRF_PAGE_FIELD (img, page, 0)));
+  printf ("\n");
+}
+
+/* The strings a lookup has printed, as a hash table which is kept at
+   most half full.  */
+typedef struct {
+  char **slots;		/* null for a free slot */
+  unsigned long nslots, count;
+} Seen_set;
+
+unsigned long
+seen_hash (const char *string)
+{
+  unsigned long hash = 0;
+
+  while (*string)
+    hash = hash * 31 + (unsigned char)*string++;
+  return hash;
+}
+
+/* Non-zero if STRING is in SEEN; if not, it is added to it.  */
+int
+seen_before (const char *string, Seen_set *seen)
+{
+  unsigned long i;
+
+  if (2 * (seen->count + 1) > seen->nslots)
+    {
+      char **old = seen->slots;
+      unsigned long nold = seen->nslots, j;
+
+      seen->nslots = nold ? 2 * nold : 64;
+      seen->slots = (char **)xmalloc (seen->nslots * sizeof (char *));
+      memset (seen->slots, 0, seen->nslots * sizeof (char *));
+      for (j = 0; j < nold; j++)
+	if (old[j])
+	  {
+	    for (i = seen_hash (old[j]) % seen->nslots; seen->slots[i];
+		 i = (i + 1) % seen->nslots)
+	      ;
+	    seen->slots[i] = old[j];
+	  }
+      free (old);
+    }
+  for (i = seen_hash (string) % seen->nslots; seen->slots[i];
+       i = (i + 1) % seen->nslots)
+    if (strcmp (seen->slots[i], string) == 0)
+      return 1;
+  seen->slots[i] = strcpy ((char *)xmalloc (strlen (string) + 1), string);
+  seen->count++;
+  return 0;
+}
+
+void
+forget_seen (Seen_set *seen)
+{
+  unsigned long i;
+
+  for (i = 0; i < seen->nslots; i++)
+    free (seen->slots[i]);
+  free (seen->slots);
+}
+
+/* List the pages which the pages of TOPIC in SECTION refer to, or if
+   REVERSE is set, the pages which refer to TOPIC, as lines
+   "section<TAB>topic<TAB>path".  The path of a reference which no
+   page answers is empty.  */
+int
+xref_lookup (const char *section, const char *topic, int reverse)
+{
+  Seen_set seen;
+  char path[2 * FILENAME_MAX];
+  int i;
+
+  memset (&seen, 0, sizeof seen);
+  open_xrf_images ();
+  for (i = 0; i < nxrf_images; i++)
+    {
+      const Xrf_image *img = &xrf_images[i];
+      unsigned long n, p, first, last, r, r_end;
+
+      for (n = xrf_topic_names (img, topic);
+	   n < img->nnames && xrf_name_matches (xrf_name (img, n), topic, "*");
+	   n++)
+	{
+	  if (!xrf_name_matches (xrf_name (img, n), topic, section))
+	    continue;
+	  if (reverse)
+	    {
+	      r_end = XRF_NAME_FIELD (img, n + 1, 2);
+	      for (r = XRF_NAME_FIELD (img, n, 2); r < r_end && r < img->nrefs; r++)
+		{
+		  p = get_u32 (img->referrers + 4 * r);
+		  if (p >= img->npages)
+		    continue;
+		  sprintf (path, "%s/%s", img->top,
+			   xrf_string (img, XRF_PAGE_FIELD (img, p, 0)));
+		  if (!seen_before (path, &seen))
+		    print_xref (xrf_name (img, XRF_PAGE_FIELD (img, p, 1)),
+				img, p);
+		}
+	      continue;
+	    }
+	  xrf_name_pages (img, n, &first, &last);
+	  for (p = first; p < last; p++)
+	    {
+	      r_end = XRF_PAGE_FIELD (img, p + 1, 4);
+	      for (r = XRF_PAGE_FIELD (img, p, 4); r < r_end && r < img->nrefs; r++)
+		{
+		  unsigned long target = get_u32 (img->refs + 4 * r), page = 0;
+		  const char *ref;
+
+		  if (target >= img->nnames)
+		    continue;
+		  ref = xrf_name (img, target);
+		  if (!seen_before (ref, &seen))
+		    {
+		      const Xrf_image *found = resolve_xref (ref, &page);
+
+		      print_xref (ref, found, page);
+		    }
+		}
+	    }
+	}
+    }
+  close_xrf_images ();
+  forget_seen (&seen);
+  return seen.count > 0 ? 0 : 2;
+}
+
+/* List the references which no page in the search path answers, as
+   lines "path<TAB>reference" with the path of the page which has the
+   reference.  Returns 2 if there are any.  */
+int
+list_dangling (void)
+{
+  int i, dangling = 0;
+
+  open_xrf_images ();
+  for (i = 0; i < nxrf_images; i++)
+    {
+      const Xrf_image *img = &xrf_images[i];
+      unsigned long n, r, r_end, page;
+
+      for (n = 0; n < img->nnames; n++)
+	{
+	  r_end = XRF_NAME_FIELD (img, n + 1, 2);
+	  r = XRF_NAME_FIELD (img, n, 2);
+	  if (r >= r_end || resolve_xref (xrf_name (img, n), &page))
+	    continue;
+	  for (; r < r_end && r < img->nrefs; r++)
+	    {
+	      unsigned long p = get_u32 (img->referrers + 4 * r);
+
+	      if (p >= img->npages)
+		continue;
+	      printf ("%s/%s\t%s\n", img->top,
+		      xrf_string (img, XRF_PAGE_FIELD (img, p, 0)),
+		      xrf_name (img, n));
+	      dangling++;
+	    }
+	}
+    }
+  close_xrf_images ();
+  if (verbose_option)
+    fprintf (stderr, "%s: %d dangling references\n", progname, dangling);
+  return dangling ? 2 : 0;
+}
+
+/* Find the pages in SECTION which name NAME among their topics in
+   their NAME lines, through the alias indices of the MANPATH
+   directories.  Used when no file is called NAME.  Returns the number
+   of pages found.  */
+int
+find_alias (const char *section, const char *name)
+{
+  const char *list = search_roots ();
+  char top[FILENAME_MAX], ext[10], want[FILENAME_MAX], have[FILENAME_MAX];
+  unsigned long hash = als_hash (name);
+  int found = 0;
+
+  if (strlen (name) >= sizeof want)
+    return 0;
+  section_pattern (section, ext);
+  if (MATCHFLAGS != 0)
+    fnmatch_fold_key (want, name);
+  else
+    strcpy (want, name);
+  while (next_path_dir (&list, top))
+    {
+      Als_image img;
+      unsigned long e, last;
+
+      if (open_als (top, &img))
+	continue;
+      for (als_bucket (&img, hash, &e, &last); e < last; e++)
+	{
+	  const char *topic = ALS_TOPIC (&img, e);
+	  const char *file = ALS_FILE (&img, e);
+	  const char *dot = strrchr (file, '.');
+	  char *path;
+	  Man_page *page;
+	  struct stat st;
+
+	  if (strlen (topic) >= sizeof have || !dot
+	      || fnmatch (ext, dot, MATCHFLAGS) != 0)
+	    continue;
+	  if (MATCHFLAGS != 0)
+	    fnmatch_fold_key (have, topic);
+	  else
+	    strcpy (have, topic);
+	  if (strcmp (have, want) != 0)
+	    continue;
+	  path = (char *)xmalloc (strlen (top) + strlen (file) + 2);
+	  sprintf (path, "%s/%s", top, file);
+	  if (stat (path, &st) != 0)
+	    {
+	      free (path);
+	      continue;
+	    }
+	  found++;
+	  if (cannot_win (strrchr (path, '/') + 1))
+	    {
+	      free (path);
+	      continue;
+	    }
+	  if (debugging_output)
+	    fprintf (stderr, "`%s' is an alias of `%s'\n", name, path);
+	  page = (Man_page *)xmalloc (sizeof (Man_page));
+	  page->path = path;
+	  page->name = strrchr (path, '/') + 1;
+	  page->section = set_section (page->name);
+	  take_page_file (page, -1);
+	}
+      unmap_file (&img.file);
+    }
+  return found;
+}
+
+/* Speculative rendering.
+
+   With --speculate N, while the pager shows a page, up to N of the pages
+   likely to be asked for next are rendered into the render cache
+   (see --budget): first the pages which -a shows after it, then those
+   which its SEE ALSO section names.  A worker process does this at
+   the lowest priority, with its CPU time and memory limited, and the
+   references are looked up in the worker, so that the lookups do not
+   disturb the list of pages being shown.  The worker for a page is
+   stopped with all its formatters when the next page is shown, and
+   the last one when man exits.  This needs fork, so DOS and Windows
+   show the pages without it.  */
+
+#if !defined (MSDOS) && !defined (__WIN32__)
+# define SPECULATE
+#endif
+
+#ifdef SPECULATE
+
+/* The limits of each process of the worker.  */
+#define SPECULATE_CPU_SECONDS	10
+#define SPECULATE_MEMORY	(128L * 1024 * 1024)
+
+/* The worker, or 0 if none is running.  */
+static pid_t speculation;
+
+/* In the worker, the file the formatter is writing, if any.  */
+static char speculation_temp[FILENAME_MAX];
+
+/* Stop the worker and the formatters it runs.  */
+void
+stop_speculation (void)
+{
+  if (speculation > 0)
+    {
+      kill (-speculation, SIGTERM);
+      waitpid (speculation, (int *)0, 0);
+      speculation = 0;
+    }
+}
+
+/* What the worker does when it is stopped by signal SIG.  */
+void
+speculation_stopped (int sig)
+{
+  (void)sig;
+  if (speculation_temp[0])
+    unlink (speculation_temp);
+  _exit (1);
+}
+
+/* In the worker, render PAGE into the render cache unless it is there
+   already.  The formatter runs where man_entry would run it, so that
+   the cache entry has the name show_page looks for.  */
+void
+speculate_page (const Man_page *page, const char *curdir)
+{
+  char cache[FILENAME_MAX], root[FILENAME_MAX], formatter[FILENAME_MAX + 16];
+  char *cmd;
+  Job_id job;
+  FILE *fp;
+  int failed, moved = 0;
+
+  if (page->flags & (FLAG_FORMATTED | FLAG_CANT_OPEN))
+    return;
+  strcpy (formatter, build_formatter_cmd (page));
+  if (page->path[0] != '.' || IS_DIR_SEP (page->path[1]))
+    {
+      page_root (page, root);
+      if (chdir (root))
+	return;
+      moved = 1;
+    }
+  if (render_cache_name (page->path, formatter, cache) == 0
+      && !usable_render (cache, page->path))
+    {
+      /* Made here, in the private directory, so that the shell only
+	 writes over it.  */
+      if ((fp = make_temp (private_dir (), speculation_temp, "w")) == 0)
+	{
+	  speculation_temp[0] = '\0';
+	  if (moved)
+	    chdir (curdir);
+	  return;
+	}
+      fclose (fp);
+      cmd = (char *)alloca (strlen (formatter) + strlen (page->path)
+			    + strlen (speculation_temp) + 10);
+      sprintf (cmd, "%s \"%s\" > \"%s\"", formatter, page->path,
+	       speculation_temp);
+      if (debugging_output)
+	fprintf (stderr, "Rendering ahead: `%s'\n", cmd);
+      if (start_job (cmd, &job) == 0 && poll_job (job, -1, &failed)
+	  && !failed)
+	replace_file (speculation_temp, cache);
+      else
+	remove (speculation_temp);
+      speculation_temp[0] = '\0';
+    }
+  if (moved)
+    chdir (curdir);
+}
+
+/* Start a worker to render the pages likely to be asked for after
+   PAGES[SHOWN], which is about to be shown.  */
+void
+start_speculation (int shown)
+{
+  static int stop_at_exit;
+  char curdir[FILENAME_MAX], topic[FILENAME_MAX], *sec;
+  struct rlimit limit;
+  Xrf_page page;
+  Mapped_file mf;
+  int left = speculate_pages, i;
+  pid_t pid;
+
+  stop_speculation ();
+  fflush (stdout);
+  fflush (stderr);
+  pid = fork ();
+  if (pid > 0)
+    {
+      /* Both set the group, so that it is there whichever runs
+	 first.  */
+      setpgid (pid, pid);
+      speculation = pid;
+      if (!stop_at_exit)
+	atexit (stop_speculation);
+      stop_at_exit = 1;
+    }
+  if (pid != 0)
+    return;
+
+  setpgid (0, 0);
+  signal (SIGTERM, speculation_stopped);
+  /* The lookups here are not the user's; the parent may be writing
+     the misses file too.  */
+  remember_misses = 0;
+  if (!debugging_output)
+    freopen (NULL_DEVICE, "w", stderr);	/* the pager has the screen */
+  nice (19);
+#ifdef RLIMIT_CPU
+  limit.rlim_cur = limit.rlim_max = SPECULATE_CPU_SECONDS;
+  setrlimit (RLIMIT_CPU, &limit);
+#endif
+#ifdef RLIMIT_AS
+  limit.rlim_cur = limit.rlim_max = SPECULATE_MEMORY;
+  setrlimit (RLIMIT_AS, &limit);
+#endif
+  if (!getcwd (curdir, sizeof curdir))
+    _exit (1);
+
+  /* -a shows the pages before SHOWN next.  */
+  for (i = shown - 1; i >= 0 && left > 0; i--, left--)
+    speculate_page (pages[i], curdir);
+  if (left <= 0 || map_page_source (pages[shown]->path, &mf))
+    _exit (0);
+
+  page.self = "";
+  page.refs = (char **)0;
+  page.nrefs = page.maxrefs = 0;
+  page.aliases = (char **)0;
+  page.naliases = 0;
+  read_xrefs (&page, (const char *)mf.data, mf.size);
+  unmap_file (&mf);
+  while (next_slot > 0)
+    remove_page (next_slot - 1);
+  for (i = 0; i < page.nrefs && left > 0; i++)
+    {
+      /* "topic(section)"  */
+      strcpy (topic, page.refs[i]);
+      sec = strrchr (topic, '(');
+      *sec++ = '\0';
+      sec[strlen (sec) - 1] = '\0';
+      page_mode = KEEP_FIRST;
+      if (find_pages (sec, topic) > 0)
+	{
+	  if (next_slot > 1)
+	    sort_pages ();
+	  speculate_page (pages[next_slot - 1], curdir);
+	  left--;
+	}
+      while (next_slot > 0)
+	remove_page (next_slot - 1);
+    }
+  _exit (0);
+}
+
+#endif /* SPECULATE */
+
+/* Display man page(s) for a topic NAME in section SECTION.  */
+int
+man_entry (const char *section, const char *name)
+{
+  int count, status = 0;
+
+  /* Unless all the pages are displayed, only the first one is needed;
+     listings go out as the pages are found.  */
+  if (list_onepath_option)
+    page_mode = KEEP_FIRST;
+  else if (list_all_option || list_fpaths_option)
+    page_mode = LIST_PAGES;
+  else
+    page_mode = show_all_option ? KEEP_DISTINCT : KEEP_FIRST;
+  count = find_pages (section, name);
+  if (count == 0 && !strpbrk (name, "*?["))
+    count = find_alias (section, name);
+
+  if (count > 0)
+    {
+      if (next_slot > 1)
 	/*  Strictly speaking, we don't need to sort the pages, but doing so
 	    makes the ``first'' page (displayed by default) predictable.  */
 	sort_pages ();
 
-      while (count--)
+      while (next_slot > 0)
 	{
 	  /* Examining the list from the end makes removing the
 	     pages easier.  The list is sorted in descending order.  */
 	  Man_page *page = pages[next_slot - 1];
 
-	  if (list_all_option || list_fpaths_option || list_onepath_option)
-      {
+	  if (list_onepath_option)
 	    list_page (page);
-        if (list_onepath_option)
-            break;
-      }
 	  else
 	    {
 	      char *curdir = NULL, *formatter_cmd = NULL;
 	      char man_dir[PATH_MAX];
 
 	      formatter_cmd = build_formatter_cmd (page);
+#ifdef SPECULATE
+	      if (speculate_pages > 0 && !direct_output)
+		start_speculation (next_slot - 1);
+#endif
 	      if (formatter_cmd
 		  && (page->path[0] != '.'  /* not relative */
 		      || (page->path[0]
@@ -726,23 +7917,21 @@ man_entry (const char *section, const char *name)
 		    }
 		  else
 		    {
-		      display_page (page->path, formatter_cmd);
+		      if (show_page (page, formatter_cmd) == 2)
+			status = 2;
 		      chdir (curdir); /* return to original directory */
 		      if (curdir)
 			free (curdir);
 		    }
 		}
-	      else
-		display_page (page->path, formatter_cmd);
-
-	      if (!show_all_option)
-		break;
+	      else if (show_page (page, formatter_cmd) == 2)
+		status = 2;
 	    }
 	  /* Now delete the page, so if we have another topic on the
 	     command line, the pages from this topic won't be considered.  */
 	  remove_page (next_slot - 1);
 	}
-      return 0;
+      return status;
     }
   else
     {
@@ -759,7 +7948,17 @@ usage (void)
   printf ("\t\tman version %s\n\n", version);
   printf ("`man' finds and displays documentation from manual pages.\n\
 \n\
-Usage:\tman [-] [-al] [-M path] [[-s] section] topic ...\n\
+Usage:\tman [-] [-alu] [--plain|--ansi] [-L locale] [-M path]\n\
+\t    [--deadline ms] [--budget ms] [--speculate n]\n\
+\t    [--section-heading heading]\n\
+\t    [[-s] section] topic ...\n\
+\tman [-L locale] [-M path] [[-s] section] --batch\n\
+\tman [-L locale] [-M path] [-j jobs] [[-s] section] --export dir\n\
+\tman [-L locale] [-M path] [-j jobs] [[-s] section] --check[-render]\n\
+\tman [-v] [-M path] -K phrase\n\
+\tman [-L locale] [-M path] [[-s] section] --regex regexp\n\
+\tman [-M path] [[-s] section] --related|--referrers topic\n\
+\tman [-v] [-M path] --dangling\n\
 \n\
 If no options are given, looks for a manual page which describes TOPIC\n\
 in directories specified by MANPATH environment variable and displays\n\
@@ -796,6 +7995,15 @@ The path to look for man pages is:\n\
 \n\
   -U         Print the full path of the first man page found.\n\
              Option is a single U, as a counterpart to the double-U.\n\
+\n\
+  -K phrase  List the pages whose text has PHRASE, best matches first.\n\
+             This uses the full-text indices -u keeps.\n\
+\n\
+  -L locale  Look for pages translated for LOCALE, like `de_DE.UTF-8',\n\
+             in subtrees like `de_DE/manN' and `de/manN' of the\n\
+             directories in the search path.  Untranslated pages are used\n\
+             when no translation is found.  By default, the locale comes\n\
+             from LC_ALL, LC_MESSAGES or LANG.  `-L C' turns this off.\n\
 \n\
   -M path    Specifies an alternate search path for manual pages.  PATH is\n\
              a list of directories separated by `%c', just like the value\n\
@@ -811,6 +8019,84 @@ The path to look for man pages is:\n\
 \n\
              A section name in short form only (1v, n, etc.) can also be\n\
 	     given without preceeding it with the -s switch.\n\
+\n\
+  -u         Update the index of each directory in the search path.  The\n\
+             index lets `man' find pages without reading the directories\n\
+             which did not change since it was updated.  Only directories\n\
+             which changed are read again.  Locale subtrees are indexed\n\
+             too.  This also updates the full-text index for -K and the\n\
+             cross-reference index for --related, reading only the pages\n\
+             which changed, and the alias index of the topics named in\n\
+             the NAME section of each page; a topic no page file is named\n\
+             after is looked up there.  Give -M first to update the\n\
+             indices in another path.\n\
+\n\
+  --batch    Read topics from standard input, one per line, as `topic',\n\
+             `section topic' or `topic(section)', and for each write the\n\
+             line `section<TAB>topic<TAB>path' with the path of the page\n\
+             -U would find, or an empty path if there is none.  Each\n\
+             directory is read only once for all the topics.\n\
+\n\
+  --regex regexp\n\
+             List the pages whose topic matches the extended regular\n\
+             expression REGEXP, as lines `section<TAB>topic<TAB>path'.\n\
+\n\
+  --related topic\n\
+             List the pages which the SEE ALSO section of TOPIC refers\n\
+             to, as lines `section<TAB>topic<TAB>path'.  The path is\n\
+             empty if no page answers the reference.  This uses the\n\
+             cross-reference indices -u keeps.\n\
+\n\
+  --referrers topic\n\
+             List the pages whose SEE ALSO section refers to TOPIC.\n\
+\n\
+  --dangling List the references which no page in the search path\n\
+             answers, as lines `path<TAB>reference'.\n\
+\n\
+  --export dir\n\
+             Render every page in the search path to HTML, as files\n\
+             NAME.html in DIR.  References to other exported pages, like\n\
+             `printf(3)', become links; those to topics only the alias\n\
+             index knows do not.  Pages whose HTML file is newer than\n\
+             the page are not rendered again.\n\
+\n\
+  --check    Check every page in the search path for files which cannot\n\
+             be read, pages which need vgrind, broken .so requests and\n\
+             formatted pages whose source is missing, and print each\n\
+             problem found.  Each kind of problem adds a bit to the exit\n\
+             status: 8, 16, 32 and 64 respectively.\n\
+\n\
+  --check-render\n\
+             Like --check, and also format every page, to find those the\n\
+             formatter fails on; these add 128 to the exit status.\n\
+\n\
+  -j jobs    Run up to JOBS formatters at a time for --export and\n\
+             --check-render.  The default is one per processor.\n\
+\n\
+  --deadline ms\n\
+             Probe the directories of the search path first, and skip\n\
+             for a minute those which do not answer within MS\n\
+             milliseconds, like dead network mounts.\n\
+\n\
+  --budget ms\n\
+             Wait no more than MS milliseconds for the formatter to start\n\
+             writing a page; then show its pre-formatted copy, an old\n\
+             rendering, or plain text made from the source instead.\n\
+\n\
+  --speculate n\n\
+             While the pager shows a page, render up to N of the pages\n\
+             likely to be asked for next in the background: those -a\n\
+             shows after it, then those its SEE ALSO section names.\n\
+\n\
+  --section-heading heading\n\
+             Show only the section of each page headed HEADING, like\n\
+             `EXAMPLES' or `SEE ALSO'.  Only that section is formatted.\n\
+\n\
+  --plain    Remove the overstrikes which make text bold or underlined\n\
+             from the output, as `col -b' would.\n\
+\n\
+  --ansi     Turn bold and underlined text into ANSI escape sequences.\n\
+             A pager needs to pass them through, like `less -R'.\n\
 \n\
   -v         Causes `man' to print messages about non-fatal errors it\n\
              encounters during the run.\n\
@@ -848,19 +8134,31 @@ main (int argc, char *argv[])
     }
 #endif
   progname = argv[0];
+  set_locales ((char *)0);
   if (argc == 1)
     return usage ();
   else
     {
+      static char batch_buf[BATCH_BUFSIZ];
       char *section = "*";
       int status = 0;
       int last_arg_was_section = 0;
+      int i;
 
       strcpy (dir_pattern1, "man?");
       strcpy (dir_pattern2, "cat?");
       if (!isatty (fileno (stdout)))
 	direct_output = 1;
 
+      /* --batch writes many short lines; the buffer must be set up
+	 before anything is written.  */
+      for (i = 1; i < argc; i++)
+	if (strcmp (argv[i], "--batch") == 0)
+	  {
+	    setvbuf (stdout, batch_buf, _IOFBF, sizeof batch_buf);
+	    break;
+	  }
+
       while (--argc)
 	{
 	  char *arg = *++argv;
@@ -872,6 +8170,113 @@ main (int argc, char *argv[])
 		  case '\0':
 		    direct_output = 1;
 		    break;
+		  case '-':
+		    if (strcmp (arg, "--plain") == 0)
+		      output_filter = FILTER_PLAIN;
+		    else if (strcmp (arg, "--ansi") == 0)
+		      output_filter = FILTER_ANSI;
+		    else if (strcmp (arg, "--batch") == 0)
+		      {
+			last_arg_was_section = 0;
+			status |= batch_lookup (section);
+		      }
+		    else if (strcmp (arg, "--deadline") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			probe_deadline = atol (argv[1]);
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--budget") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			render_budget = atol (argv[1]);
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--speculate") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			speculate_pages = atoi (argv[1]);
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--section-heading") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			section_heading = argv[1];
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--regex") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			last_arg_was_section = 0;
+			status |= regex_lookup (section, argv[1]);
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--check") == 0
+			     || strcmp (arg, "--check-render") == 0)
+		      {
+			last_arg_was_section = 0;
+			check_render = (arg[7] != '\0');
+			status |= check_pages (section);
+		      }
+		    else if (strcmp (arg, "--related") == 0
+			     || strcmp (arg, "--referrers") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			last_arg_was_section = 0;
+			status |= xref_lookup (section, argv[1], arg[4] == 'f');
+			--argc; ++argv;
+		      }
+		    else if (strcmp (arg, "--dangling") == 0)
+		      status |= list_dangling ();
+		    else if (strcmp (arg, "--export") == 0)
+		      {
+			if (argc < 2)
+			  {
+			    fprintf (stderr, "%s: missing argument to %s\n",
+				     progname, arg);
+			    return 2;
+			  }
+			last_arg_was_section = 0;
+			status |= export_pages (argv[1], section);
+			--argc; ++argv;
+		      }
+		    else
+		      {
+			fprintf (stderr, "%s: unknown option %s\n",
+				 progname, arg);
+			return 1;
+		      }
+		    break;
 		  case 'a':
 		    show_all_option = 1;
 		    break;
@@ -887,6 +8292,10 @@ main (int argc, char *argv[])
 		  case 'v':
 		    verbose_option = 1;
 		    break;
+		  case 'u':
+		    status |= update_indexes ();
+		    status |= update_xrefs ();
+		    break;
           case 'h':
             return usage();
             break;
@@ -905,6 +8314,37 @@ main (int argc, char *argv[])
 		    manpath = argv[1];
 		    --argc; ++argv;
 		    break;
+		  case 'j':
+		    if (argc < 2)
+		      {
+			fprintf (stderr, "%s: missing argument to -j\n",
+				 progname);
+			return 2;
+		      }
+		    export_jobs = atoi (argv[1]);
+		    --argc; ++argv;
+		    break;
+		  case 'K':
+		    if (argc < 2)
+		      {
+			fprintf (stderr, "%s: missing argument to -K\n",
+				 progname);
+			return 2;
+		      }
+		    last_arg_was_section = 0;
+		    status |= search_pages (argv[1]);
+		    --argc; ++argv;
+		    break;
+		  case 'L':
+		    if (argc < 2)
+		      {
+			fprintf (stderr, "%s: missing argument to -L\n",
+				 progname);
+			return 2;
+		      }
+		    set_locales (argv[1]);
+		    --argc; ++argv;
+		    break;
 		  case 's':
 		    /* FIXME: handle multiple sections like "-s 3,5,n" etc.  */
 		    if (argc <= 0)